@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+// A single algorithm run off the UI thread. The work gets its own copy (or
+// an unchanged view) of the graph, reports its progress and checks for the
+// cancellation through the Control. Its result is published by a separate
+// function, called on the UI thread from poll(), so the windows never see
+// a half done result. Without the threads (see NO_THREADS) the work is done
+// in start(), and published on the next poll() all the same.
+class AlgorithmJob {
+public:
+    class Control {
+    private:
+        atomic<bool> cancelled;
+        atomic<long long> progress;
+
+    public:
+        Control();
+
+        bool is_cancelled() const;
+        void add_progress(long long count = 1);
+        long long get_progress() const;
+
+        void reset();
+        void cancel();
+    };
+
+    using Work = function<void(Control&)>;
+    using Publish = function<void()>;
+
+private:
+    Control control;
+    thread worker;
+    atomic<bool> finished;
+    bool running;
+    Publish publish;
+    // What the progress counts, like "nodes settled"
+    string progress_label;
+
+public:
+    AlgorithmJob();
+    AlgorithmJob(const AlgorithmJob&) = delete;
+    AlgorithmJob& operator=(const AlgorithmJob&) = delete;
+    ~AlgorithmJob();
+
+    // Cancels the running job first
+    void start(const string& progress_label, Work work, Publish publish);
+    // Waits for the work to stop, nothing is published then
+    void cancel();
+    // Called once a frame, publishes the finished job. True if it did.
+    bool poll();
+
+    bool is_running() const;
+    long long get_progress() const;
+    const string& get_progress_label() const;
+};
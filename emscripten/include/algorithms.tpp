@@ -1,6 +1,10 @@
 #pragma once
 
 #include "field.h"
+#include "step_trace.h"
+#include "algorithm_job.h"
+#include "landmarks.h"
+#include "search_context.h"
 
 #include <queue>
 #include <stack>
@@ -21,16 +25,11 @@ namespace algos {
     // TASK 1
     void bfs(
         Field& field, int graph_id, int start_point = 0,
-        int* total_steps = nullptr, int step = -1
+        StepTrace* trace = nullptr
     ) {
         Graph& graph = *field.get_graph(graph_id);
-        const int n = graph.connections.size();
-        int steps_counter = 0;
-        if(n == 0) {
-            if(total_steps != nullptr)
-                *total_steps = steps_counter;
-            return;
-        }
+        const int n = graph.n;
+        if(n == 0) return;
 
         field.disselect_all_edges();
         field.disselect_all_points();
@@ -44,8 +43,7 @@ namespace algos {
             start_point, graph_id,
             BLUE_COLOR
         );
-        if(step == steps_counter)
-            return;
+        if(trace != nullptr) trace->end_step();
 
         while (!q.empty())
         {
@@ -56,8 +54,9 @@ namespace algos {
             );
 
             q.pop();
-            for(int i = 0; i < n; i++)
-                if(graph.connections[buff][i] && !visited[i]){
+            for(const auto arc : graph.neighbors(buff))
+                if(!visited[arc.to]){
+                    const int i = arc.to;
                     q.push(i);
                     visited[i] = true;
                     field.select_point(
@@ -72,35 +71,29 @@ namespace algos {
                     );
                 }
 
-            steps_counter++;
-            if(step == steps_counter)
-                return;
+            if(trace != nullptr) trace->end_step();
         }
 
-        steps_counter++;
         field.select_point(start_point, graph_id);
-        if(total_steps != nullptr)
-            *total_steps = steps_counter;
     }
 
     // TASK 2
     void _dfs(
         Field& field, Graph& graph, const int& graph_id, const int& n,
         vector<bool>& visited, int from, int parent,
-        int& steps_counter, int* total_steps = nullptr, int step = -1
+        StepTrace* trace = nullptr
     ) {
-        if(step == steps_counter)
-            return;
+        if(trace != nullptr) trace->end_step();
 
         visited[from] = true;
         field.select_point(
             from, graph_id,
             GRAY_COLOR
         );
-        steps_counter++;
 
-        for(int i = 0; i < n; i++)
-            if(graph.connections[from][i] && !visited[i]){
+        for(const auto arc : graph.neighbors(from))
+            if(!visited[arc.to]){
+                const int i = arc.to;
                 field.select_point(
                     i, graph_id,
                     BLUE_COLOR
@@ -108,7 +101,7 @@ namespace algos {
                 _dfs(
                     field, graph, graph_id, n,
                     visited, i, from,
-                    steps_counter, total_steps, step
+                    trace
                 );
             }
 
@@ -121,16 +114,11 @@ namespace algos {
     }
     void dfs(
         Field& field, int graph_id, int start_point = 0,
-        int* total_steps = nullptr, int step = -1
+        StepTrace* trace = nullptr
     ) {
         Graph& graph = *field.get_graph(graph_id);
-        const int n = graph.connections.size();
-        int steps_counter = 0;
-        if(n == 0) {
-            if(total_steps != nullptr)
-                *total_steps = steps_counter;
-            return;
-        }
+        const int n = graph.n;
+        if(n == 0) return;
 
         field.disselect_all_edges();
         field.disselect_all_points();
@@ -138,21 +126,15 @@ namespace algos {
             start_point, graph_id,
             BLUE_COLOR
         );
-        if(step == steps_counter)
-            return;
-
+        // The first step ends on entering the start point
         vector<bool> visited(n);
         _dfs(
             field, graph, graph_id, n,
             visited, start_point, -1,
-            steps_counter, total_steps, step
+            trace
         );
 
-        steps_counter++;
-        if(total_steps != nullptr && *total_steps < steps_counter)
-            *total_steps = steps_counter;
-        if(*total_steps == step || step == -1)
-            field.select_point(start_point, graph_id);
+        field.select_point(start_point, graph_id);
     }
 
     // Task 3
@@ -160,16 +142,11 @@ namespace algos {
     { return a.first > b.first; }
     void prims_min_tree(
         Field& field, int graph_id, int start_point = 0,
-        int* total_steps = nullptr, int step = -1
+        StepTrace* trace = nullptr
     ) {
         Graph& graph = *field.get_graph(graph_id);
-        const int n = graph.connections.size();
-        int steps_counter = 0;
-        if(n == 0) {
-            if(total_steps != nullptr)
-                *total_steps = steps_counter;
-            return;
-        }
+        const int n = graph.n;
+        if(n == 0) return;
 
         vector<bool> visited(n);
         stack<pair<int, int>> q;
@@ -178,8 +155,7 @@ namespace algos {
             start_point, graph_id,
             BLUE_COLOR
         );
-        if(step == steps_counter)
-            return;
+        if(trace != nullptr) trace->end_step();
 
         while (!q.empty())
         {
@@ -201,9 +177,9 @@ namespace algos {
                 );
 
             vector<pair<int, int>> possible;
-            for(int i = 0; i < n; i++)
-                if(graph.connections[to][i] && !visited[i]){
-                    possible.push_back({graph.connections[to][i].weight, i});
+            for(const auto arc : graph.neighbors(to))
+                if(!visited[arc.to]){
+                    possible.push_back({arc.weight, arc.to});
                 }
             sort(possible.begin(), possible.end(), _pairs_descending);
             for(auto p : possible) {
@@ -214,189 +190,149 @@ namespace algos {
                 );
             }
 
-            steps_counter++;
-            if(step == steps_counter)
-                return;
+            if(trace != nullptr) trace->end_step();
         }
 
-        steps_counter++;
         field.select_point(start_point, graph_id);
-        if(total_steps != nullptr)
-            *total_steps = steps_counter;
     }
 
     // Task 4
+    // Without the context a temporary one is used
     void dijkstra_path(
         Field& field, int graph_id, int from = 0, int to = -1,
-        int* total_steps = nullptr, int step = -1
+        StepTrace* trace = nullptr, SearchContext* context = nullptr
     ) {
         Graph& graph = *field.get_graph(graph_id);
-        const int n = graph.connections.size();
-        int steps_counter = 0;
-        if(n == 0) {
-            if(total_steps != nullptr)
-                *total_steps = steps_counter;
-            return;
-        }
+        const int n = graph.n;
+        if(n == 0) return;
         if(to == -1) to = n - 1;
 
-        struct segment {
-            vector<int> path;
-            int length;
-
-            segment(): path(), length(-1) {}
-            segment(vector<int> path, int length): path(path), length(length) {}
-        };
-        vector<segment> distances(n);
-        queue<int> q;
-        int prev = -1;
-        q.push(from);
-        distances[from] = {{from}, 0};
+        // Binary heap with the lazy deletion: a node may be pushed a few
+        // times, only the entry with its current distance is taken. The
+        // shortest path tree is kept in the parents of the labels, and the
+        // path is built once at the end.
+        SearchContext local_context;
+        SearchContext& ctx = context != nullptr ? *context : local_context;
+        ctx.reset(n);
+        SearchContext::Side& side = ctx.get_side(0);
+
+        const auto& edge_ids = graph.get_adjacency().edge_ids;
+        side.reach(from, 0);
+        side.push(0, from);
         field.select_point(
             from, graph_id,
             BLUE_COLOR
         );
-        if(step == steps_counter)
-            return;
+        if(trace != nullptr) trace->end_step();
 
-        while(!q.empty()) {
-            int buff = q.front();
-            q.pop();
-            if(prev == buff) continue;
-            else prev = buff;
+        while(!side.empty()) {
+            const int buff = side.top().second;
+            const double distance = side.top().first;
+            side.pop();
+            if(side.is_settled(buff) || distance != side.get_distance(buff)) continue;
+            side.settle(buff);
 
             field.select_point(
                 buff, graph_id,
                 GRAY_COLOR
             );
-            
-            for(int i = 0; i < n; i++)
-                if(graph.connections[i][buff] && (
-                    distances[i].length == -1 || 
-                    distances[i].length > distances[buff].length + 
-                    graph.connections[i][buff].weight)
-                ) {
-                    {
-                        int j = 1;
-                        while(
-                            j < distances[i].path.size() && j < distances[buff].path.size() &&
-                            distances[i].path[j] == distances[buff].path[j]
-                        ) j++;
-                        for(int k = j; k < distances[i].path.size(); k++)
-                            field.disselect_edge(
-                                graph.get_edge_id(
-                                    distances[i].path[k-1],
-                                    distances[i].path[k]
-                                )
-                            );
-                        field.select_edge(graph.get_edge_id(
-                            distances[buff].path[distances[buff].path.size()-1], i));
-                    }
 
-                    distances[i].length = distances[buff].length + 
-                        graph.connections[i][buff].weight;
-                    distances[i].path = distances[buff].path;
-                    distances[i].path.push_back(i);
-                    q.push(i);
+            for(const auto arc : graph.neighbors(buff)) {
+                const int i = arc.to;
+                if(side.is_settled(i) ||
+                    (side.is_reached(i) && side.get_distance(i) <= distance + arc.weight)
+                ) { continue; }
 
-                    field.select_point(
-                        i, graph_id,
-                        BLUE_COLOR
-                    );
-                }
-            
-            steps_counter++;
-            if(step == steps_counter)
-                return;
+                // Only the tree edge of i changes
+                if(side.get_parent_edge(i) != -1)
+                    field.disselect_edge(side.get_parent_edge(i), graph_id);
+                side.reach(i, distance + arc.weight, buff, edge_ids[arc.index]);
+                field.select_edge(side.get_parent_edge(i), graph_id);
+                side.push(distance + arc.weight, i);
+
+                field.select_point(
+                    i, graph_id,
+                    BLUE_COLOR
+                );
+            }
+
+            if(trace != nullptr) trace->end_step();
         }
 
-        steps_counter++;
         field.select_point(from, graph_id);
         field.select_point(to, graph_id, GREEN_COLOR);
         field.disselect_all_edges();
-        for(int i = 1; i < distances[to].path.size(); i++) {
-            field.select_edge(graph.get_edge_id(
-                distances[to].path[i-1],
-                distances[to].path[i]
-            ), 0);
-        }
-        if(total_steps != nullptr)
-            *total_steps = steps_counter;
+        for(int i = to; side.get_parent(i) != -1; i = side.get_parent(i))
+            field.select_edge(side.get_parent_edge(i), graph_id);
     }
 
     // Task 5
+    // Without the context a temporary one is used
     void astar_path(
         Field& field, int graph_id = 0, int from = 0, int to = -1, ostream* log = nullptr,
-        int* total_steps = nullptr, int step = -1
+        StepTrace* trace = nullptr, SearchContext* context = nullptr
     ) {
         const Graph& graph = *field.get_graph(graph_id);
-        const int n = graph.connections.size();
-        int steps_counter = 0;
-        if(n == 0) {
-            if(total_steps != nullptr)
-                *total_steps = steps_counter;
-            return;
-        }
+        const int n = graph.n;
+        if(n == 0) return;
         if(to == -1) to = n - 1;
-        
-        vector<float> distances(n, -1);
-        vector<int> cameFrom(n, -1);
-        auto cmp = [&](int a, int b) { 
-            float ad = distances[a] + field.get_field_distance(graph_id, a, to);
-            float bd = distances[b] + field.get_field_distance(graph_id, b, to);
-            return ad > bd; 
+
+        SearchContext local_context;
+        SearchContext& ctx = context != nullptr ? *context : local_context;
+        ctx.reset(n);
+        SearchContext::Side& side = ctx.get_side(0);
+        // The heap keys are the distance plus the estimate to the end
+        const auto get_key = [&](int node) {
+            return side.get_distance(node) + field.get_field_distance(graph_id, node, to);
         };
-        priority_queue<int, vector<int>, decltype(cmp)> q(cmp);
-        int prev = -1;
-        distances[from] = 0;
-        q.push(from);
+
+        side.reach(from, 0);
+        side.push(get_key(from), from);
         field.select_point(
             from, graph_id,
             BLUE_COLOR
         );
-        if(step == steps_counter)
-            return;
+        if(trace != nullptr) trace->end_step();
 
-        while(!q.empty()) {
-            int buff = q.top();
-            q.pop();
+        while(!side.empty()) {
+            int buff = side.top().second;
+            side.pop();
             if(buff == to) break;
-            else if(buff == prev) continue;
-            else prev = buff;
+            else if(side.is_settled(buff)) continue;
+            side.settle(buff);
             
             if(log != nullptr)
-                *log<<"Node: "<<buff<<" (d="<<distances[buff]<<")\n";
+                *log<<"Node: "<<buff<<" (d="<<side.get_distance(buff)<<")\n";
             field.select_point(
                 buff, graph_id,
                 GRAY_COLOR
             );
 
-            for(int i = 0; i < n; i++)
-                if(graph.connections[i][buff] && (
-                    distances[i] == -1 || 
-                    distances[i] > distances[buff] + 
-                    field.get_field_distance(graph_id, i, buff))
+            for(const auto arc : graph.neighbors(buff))
+                if(!side.is_reached(arc.to) || 
+                    side.get_distance(arc.to) > side.get_distance(buff) + 
+                    field.get_field_distance(graph_id, arc.to, buff)
                 ) {
+                    const int i = arc.to;
                     {
                         int prev = i;
-                        while(cameFrom[prev] != -1) {
+                        while(side.get_parent(prev) != -1) {
                             field.disselect_edge(
-                                graph.get_edge_id(prev, cameFrom[prev]));
-                            prev = cameFrom[prev];
+                                graph.get_edge_id(prev, side.get_parent(prev)));
+                            prev = side.get_parent(prev);
                         }
                     }
 
-                    distances[i] = distances[buff] + 
-                        field.get_field_distance(graph_id, i, buff);
-                    cameFrom[i] = buff;
-                    q.push(i);
+                    side.reach(i, side.get_distance(buff) + 
+                        field.get_field_distance(graph_id, i, buff), buff);
+                    side.push(get_key(i), i);
 
                     {
                         int prev = i;
-                        while(cameFrom[prev] != -1) {
+                        while(side.get_parent(prev) != -1) {
                             field.select_edge(
-                                graph.get_edge_id(prev, cameFrom[prev]));
-                            prev = cameFrom[prev];
+                                graph.get_edge_id(prev, side.get_parent(prev)));
+                            prev = side.get_parent(prev);
                         }
                     }
                     field.select_point(
@@ -405,30 +341,25 @@ namespace algos {
                     );
                 }
 
-            steps_counter++;
-            if(step == steps_counter)
-                return;
+            if(trace != nullptr) trace->end_step();
         }
 
-        steps_counter++;
         field.disselect_all_edges();
         field.disselect_all_points();
         field.select_point(from, graph_id);
         field.select_point(to, graph_id, GREEN_COLOR);
         int last = to;
-        while(last != from) {
+        while(last != from && side.get_parent(last) != -1) {
             field.select_edge(
-                graph.get_edge_id(last, cameFrom[last]));
-            last = cameFrom[last];
+                graph.get_edge_id(last, side.get_parent(last)));
+            last = side.get_parent(last);
         }
-        if(total_steps != nullptr)
-            *total_steps = steps_counter;
     }
 
     // Task 6
     namespace {
         bool _ff_bfs(Graph& graph, int from, int to, vector<int>& comeFrom) {
-            const int n = graph.connections.size();
+            const int n = graph.n;
             vector<bool> visited(n);
             visited[from] = true;
             queue<int> q;
@@ -436,14 +367,11 @@ namespace algos {
             while(!q.empty()) {
                 int buff = q.front();
                 q.pop();
-                for(int i = 0; i < n; i++)
-                    if(graph.connections[buff][i].connected && 
-                        graph.connections[buff][i].weight > 0 &&
-                        !visited[i]
-                    ){
-                        q.push(i);
-                        visited[i] = true;
-                        comeFrom[i] = buff;
+                for(const auto arc : graph.neighbors(buff))
+                    if(arc.weight > 0 && !visited[arc.to]){
+                        q.push(arc.to);
+                        visited[arc.to] = true;
+                        comeFrom[arc.to] = buff;
                     }
             }
             return visited[to];
@@ -455,22 +383,39 @@ namespace algos {
 
         FFMaxFlowRes(Graph flowData): maxFlow(-1), flowData(move(flowData)) {}
     };
-    FFMaxFlowRes ff_max_flow(Field& field, int graph_id = 0, int from = 0, int to = -1) {
-        FFMaxFlowRes res(*field.get_graph(graph_id));
+    // The progress is the count of the augmenting paths found
+    FFMaxFlowRes ff_max_flow(
+        const Graph& source, int from = 0, int to = -1,
+        AlgorithmJob::Control* control = nullptr
+    ) {
+        FFMaxFlowRes res(source);
         Graph& graph = res.flowData;
-        const int n = graph.connections.size();
+        const int n = graph.n;
         if(n == 0) return res;
         if(to == -1) to = n - 1;
+        // Out of the graph, or no flow to find
+        if(from < 0 || to < 0 || from >= n || to >= n || from == to) return res;
 
         vector<int> comeFrom(n);
         res.maxFlow = 0;
 
+        // The residual capacities are kept in the arc weights
+        vector<Graph::T>& weights = graph.get_adjacency().weights;
         while(_ff_bfs(graph, from, to, comeFrom)) {
+            if(control != nullptr) {
+                if(control->is_cancelled()) {
+                    res.maxFlow = -1;
+                    return res;
+                }
+                control->add_progress();
+            }
+
             int pathFlow = -1;
             int i = to;
             while(i != from) {
-                if(pathFlow == -1 || pathFlow > graph.connections[comeFrom[i]][i].weight)
-                    pathFlow = graph.connections[comeFrom[i]][i].weight;
+                const int arc = graph.find_arc(comeFrom[i], i);
+                if(pathFlow == -1 || pathFlow > weights[arc])
+                    pathFlow = weights[arc];
                 i = comeFrom[i];
             }
 
@@ -479,57 +424,18 @@ namespace algos {
             i = to;
             while(i != from) {
                 int buff = comeFrom[i];
-                graph.connections[buff][i].weight -= pathFlow;
-                graph.connections[i][buff].weight += pathFlow;
+                weights[graph.find_arc(buff, i)] -= pathFlow;
+                weights[graph.find_arc(i, buff)] += pathFlow;
                 i = buff;
             }
         }
 
         return res;
     }
+    FFMaxFlowRes ff_max_flow(Field& field, int graph_id = 0, int from = 0, int to = -1)
+    { return ff_max_flow(*field.get_graph(graph_id), from, to); }
 
     // Task 7
-    namespace {
-        struct _comparator {
-            const vector<int> *distances;
-            const SparseGraphView* graph_view;
-            const int node;
-
-            _comparator(const vector<int> *distances, const SparseGraphView* graph_view = nullptr, int node = -1):
-                distances(distances), graph_view(graph_view), node(node) {}
-
-            bool operator()(int a, const int b) const { 
-                if (graph_view != nullptr) {
-                    const float ad = distances->at(a) + graph_view->get_distance(a, node);
-                    const float bd = distances->at(b) + graph_view->get_distance(b, node);
-                    return ad > bd;
-                }
-                else {
-                    return distances->at(a) > distances->at(b);
-                }
-            }
-        };
-
-        int _dijkstra_step(
-            SparseGraph& graph, vector<int>& distances, vector<int>& cameFrom,
-            priority_queue<int, vector<int>, _comparator>* q, ostream* log
-        ) {
-            int buff = q->top();
-            q->pop();
-            for(int i = 0; i < graph.n; i++) {
-                if(!graph.is_connected(buff, i)) continue;
-                const auto& edge = graph.get_edge(buff, i);
-                if(distances[i] == -1 || 
-                    distances[i] > distances[buff] + edge.weight
-                ) {
-                    distances[i] = distances[buff] + edge.weight;
-                    cameFrom[i] = buff;
-                    q->push(i);
-                }
-            }
-            return buff;
-        }
-    }
     struct bidirect_result {
         vector<int> path;
         vector<int> checked_nodes;
@@ -538,182 +444,162 @@ namespace algos {
         bidirect_result(vector<int> path, vector<int> checked_nodes):
             path(path), checked_nodes(checked_nodes) {}
     };
-    bidirect_result bidirect_dijkstra_path(SparseGraph& graph, int from = 0, int to = -1, ostream* log = nullptr) {
-        const int n = graph.n;
-        if(n == 0) return {};
-        if(to == -1) to = n - 1;
-        
-        set<int> checked_nodes;
-        vector<int> distances_from(n, -1), distances_to(n, -1),
-            parent_from(n, -1), parent_to(n, -1);
-        _comparator from_cmp(&distances_from), to_cmp(&distances_to);
-        priority_queue<int, vector<int>, _comparator> q_from(from_cmp), q_to(to_cmp);
-
-        q_from.push(from);
-        distances_from[from] = 0;
-        q_to.push(to);
-        distances_to[to] = 0;
-        int middle = -1;
-        int buff;
-        while(!q_from.empty() && !q_to.empty()) {
-            buff = _dijkstra_step(graph, distances_from, parent_from, &q_from, log);
-            checked_nodes.insert(buff);
-            if (distances_to[buff] != -1) {
-                middle = buff;
-                break;
+    namespace {
+        // The bidirectional search with the potential p (0 for Dijkstra):
+        // the forward keys are d_f(v) + p(v), the backward ones d_b(v) - p(v),
+        // so both searches see the same nonnegative reduced weights if p is
+        // consistent. mu, the shortest path seen through an arc joining the
+        // searches, is updated on every relaxation, and the search stops
+        // once top_f + top_b >= mu, nothing shorter can be found then.
+        // The labels are left in the context, -1 if there is no path.
+        template<typename Potential>
+        double _bidirect_search(
+            const SparseGraph& graph, int from, int to, const Potential& potential,
+            SearchContext& ctx, pair<int, int>& connection, AlgorithmJob::Control* control
+        ) {
+            ctx.reset(graph.n);
+            SearchContext::Side* sides[2] = {&ctx.get_side(0), &ctx.get_side(1)};
+            const double signs[2] = {1, -1};
+
+            sides[0]->reach(from, 0);
+            sides[0]->push(potential(from), from);
+            sides[1]->reach(to, 0);
+            sides[1]->push(-potential(to), to);
+
+            double mu = -1;
+            connection = {-1, -1};
+            if(from == to) {
+                mu = 0;
+                connection = {from, to};
             }
-
-            buff = _dijkstra_step(graph, distances_to, parent_to, &q_to, log);
-            checked_nodes.insert(buff);
-            if (distances_from[buff] != -1) {
-                middle = buff;
-                break;
+            for(int side = 0; !sides[0]->empty() && !sides[1]->empty(); side ^= 1) {
+                if(mu != -1 && sides[0]->top().first + sides[1]->top().first >= mu) break;
+                if(control != nullptr && control->is_cancelled()) return -1;
+
+                SearchContext::Side& own = *sides[side];
+                const SearchContext::Side& other = *sides[side ^ 1];
+                const int node = own.top().second;
+                own.pop();
+                // The first pop is the shortest, the later ones are stale
+                if(own.is_settled(node)) continue;
+                own.settle(node);
+                ctx.check(node);
+                if(control != nullptr) control->add_progress();
+
+                const double distance = own.get_distance(node);
+                for(const auto arc : graph.neighbors(node)) {
+                    const int next = arc.to;
+                    const double next_distance = distance + arc.weight;
+                    if(!own.is_reached(next) || own.get_distance(next) > next_distance) {
+                        own.reach(next, next_distance, node);
+                        own.push(next_distance + signs[side] * potential(next), next);
+                    }
+                    if(other.is_reached(next) &&
+                        (mu == -1 || next_distance + other.get_distance(next) < mu)
+                    ) {
+                        mu = next_distance + other.get_distance(next);
+                        connection = side == 0 ? pair<int, int>{node, next} : pair<int, int>{next, node};
+                    }
+                }
             }
+            return mu;
         }
 
-        if(middle == -1) return {};
-        int prev_d = -1;
-        pair<int, int> connection{-1, -1};
-        for(int i = 0; i < n; i++)
-        for(int j = 0; j < n; j++)
-        {
-            if(distances_to[j] == -1 || distances_from[i] == -1) continue;
-            if(!graph.is_connected(i, j)) continue;
-            int cur_d = distances_to[j] + distances_from[i] + graph.get_edge(i, j).weight;
-            if(prev_d == -1 || prev_d > cur_d) {
-                connection = {i, j};
-                prev_d = cur_d;
+        bidirect_result _bidirect_result(
+            int from, int to, const SearchContext& ctx, pair<int, int> connection, ostream* log
+        ) {
+            vector<int> ret;
+            int cur = connection.second;
+            while(cur != to) {
+                ret.push_back(cur);
+                cur = ctx.get_side(1).get_parent(cur);
             }
-        }
-
-        if(prev_d == -1) return {};
+            ret.push_back(to);
 
-        vector<int> ret;
-        int cur = connection.second;
-        while(cur != to) {
-            ret.push_back(cur);
-            cur = parent_to[cur];
-        }
-        ret.push_back(to);
-
-        reverse(ret.begin(), ret.end());
-        cur = connection.first;
-        while(cur != from) {
-            ret.push_back(cur);
-            cur = parent_from[cur];
-        }
-        ret.push_back(from);
-
-        reverse(ret.begin(), ret.end());
-
-        if(log != nullptr){
-            *log << "Number of checked nodes: " << checked_nodes.size() << "\n";
-            *log << "Checked nodes:\n";
-            int count = 0;
-            for(int i : checked_nodes){
-                *log << i << " ";
-                count++;
-                if(count > 10) *log << "\n";
+            reverse(ret.begin(), ret.end());
+            cur = connection.first;
+            while(cur != from) {
+                ret.push_back(cur);
+                cur = ctx.get_side(0).get_parent(cur);
             }
+            ret.push_back(from);
+
+            reverse(ret.begin(), ret.end());
+            // The start equal to the end is joined with itself
+            if(from == to) ret.resize(1);
+
+            // Sorted for the log, as they used to be
+            vector<int> checked_nodes = ctx.get_checked_nodes();
+            sort(checked_nodes.begin(), checked_nodes.end());
+
+            if(log != nullptr){
+                *log << "Number of checked nodes: " << checked_nodes.size() << "\n";
+                *log << "Checked nodes:\n";
+                int count = 0;
+                for(int i : checked_nodes){
+                    *log << i << " ";
+                    count++;
+                    if(count > 10) *log << "\n";
+                }
 
-            *log << "\nResulting path:\n";
-            for(int i = 0; i < ret.size(); i++){
-                *log << ret[i];
-                if(i < ret.size() - 1)
-                    *log << " - ";
+                *log << "\nResulting path:\n";
+                for(int i = 0; i < ret.size(); i++){
+                    *log << ret[i];
+                    if(i < ret.size() - 1)
+                        *log << " - ";
+                }
             }
+
+            return {ret, move(checked_nodes)};
         }
+    }
+    // The progress is the count of the settled nodes. Without the context
+    // a temporary one is used.
+    bidirect_result bidirect_dijkstra_path(
+        SparseGraph& graph, int from = 0, int to = -1, ostream* log = nullptr,
+        AlgorithmJob::Control* control = nullptr, SearchContext* context = nullptr
+    ) {
+        const int n = graph.n;
+        if(n == 0) return {};
+        if(to == -1) to = n - 1;
+        if(from < 0 || to < 0 || from >= n || to >= n) return {};
 
-        return {ret, {checked_nodes.begin(), checked_nodes.end()}};
+        SearchContext local_context;
+        SearchContext& ctx = context != nullptr ? *context : local_context;
+        pair<int, int> connection;
+        const auto zero = [](int) { return 0.0; };
+        if(_bidirect_search(graph, from, to, zero, ctx, connection, control) == -1) return {};
+
+        return _bidirect_result(from, to, ctx, connection, log);
     }
 
     // Task 8
-    bidirect_result bidirect_astar_path(SparseGraphView& graph_view, int from = 0, int to = -1, ostream* log = nullptr) {
+    // With the landmarks given, their bounds are the heuristic (ALT), else
+    // the straight line distance. The potential is the average of the
+    // estimates to the end and from the start, consistent for both sides.
+    bidirect_result bidirect_astar_path(
+        SparseGraphView& graph_view, int from = 0, int to = -1, ostream* log = nullptr,
+        AlgorithmJob::Control* control = nullptr, const Landmarks* landmarks = nullptr,
+        SearchContext* context = nullptr
+    ) {
         const int n = graph_view.graph.n;
         if(n == 0) return {};
         if(to == -1) to = n - 1;
-        
-        set<int> checked_nodes;
-        vector<int> distances_from(n, -1), distances_to(n, -1),
-            parent_from(n, -1), parent_to(n, -1);
-        _comparator from_cmp(&distances_from, &graph_view, from), to_cmp(&distances_to, &graph_view, to);
-        priority_queue<int, vector<int>, _comparator> q_from(from_cmp), q_to(to_cmp);
-
-        q_from.push(from);
-        distances_from[from] = 0;
-        q_to.push(to);
-        distances_to[to] = 0;
-        int middle = -1;
-        int buff;
-        while(!q_from.empty() && !q_to.empty()) {
-            buff = _dijkstra_step(graph_view.graph, distances_from, parent_from, &q_from, log);
-            checked_nodes.insert(buff);
-            if (distances_to[buff] != -1) {
-                middle = buff;
-                break;
-            }
-
-            buff = _dijkstra_step(graph_view.graph, distances_to, parent_to, &q_to, log);
-            checked_nodes.insert(buff);
-            if (distances_from[buff] != -1) {
-                middle = buff;
-                break;
-            }
-        }
-
-        if(middle == -1) return {};
-        int prev_d = -1;
-        pair<int, int> connection{-1, -1};
-        for(int i = 0; i < n; i++)
-        for(int j = 0; j < n; j++)
-        {
-            if(distances_to[j] == -1 || distances_from[i] == -1) continue;
-            if(!graph_view.graph.is_connected(i, j)) continue;
-            int cur_d = distances_to[j] + distances_from[i] + graph_view.graph.get_edge(i, j).weight;
-            if(prev_d == -1 || prev_d > cur_d) {
-                connection = {i, j};
-                prev_d = cur_d;
-            }
-        }
-
-        if(prev_d == -1) return {};
-
-        vector<int> ret;
-        int cur = connection.second;
-        while(cur != to) {
-            ret.push_back(cur);
-            cur = parent_to[cur];
-        }
-        ret.push_back(to);
-
-        reverse(ret.begin(), ret.end());
-        cur = connection.first;
-        while(cur != from) {
-            ret.push_back(cur);
-            cur = parent_from[cur];
-        }
-        ret.push_back(from);
-
-        reverse(ret.begin(), ret.end());
-
-        if(log != nullptr){
-            *log << "Number of checked nodes: " << checked_nodes.size() << "\n";
-            *log << "Checked nodes:\n";
-            int count = 0;
-            for(int i : checked_nodes){
-                *log << i << " ";
-                count++;
-                if(count > 10) *log << "\n";
-            }
-
-            *log << "\nResulting path:\n";
-            for(int i = 0; i < ret.size(); i++){
-                *log << ret[i];
-                if(i < ret.size() - 1)
-                    *log << " - ";
-            }
-        }
+        if(from < 0 || to < 0 || from >= n || to >= n) return {};
+
+        SearchContext local_context;
+        SearchContext& ctx = context != nullptr ? *context : local_context;
+        pair<int, int> connection;
+        const auto estimate = [&](int a, int b) -> double {
+            if(landmarks != nullptr) return landmarks->get_lower_bound(a, b);
+            return graph_view.get_distance(a, b);
+        };
+        const auto potential = [&](int node) {
+            return (estimate(node, to) - estimate(from, node)) / 2;
+        };
+        if(_bidirect_search(graph_view.graph, from, to, potential, ctx, connection, control) == -1)
+            return {};
 
-        return {ret, {checked_nodes.begin(), checked_nodes.end()}};
+        return _bidirect_result(from, to, ctx, connection, log);
     }
-}
\ No newline at end of file
+}
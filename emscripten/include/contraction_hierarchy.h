@@ -0,0 +1,93 @@
+#pragma once
+
+#include "graph.h"
+#include "algorithm_job.h"
+
+#include <cstdint>
+#include <vector>
+#include <string>
+
+using namespace std;
+
+// Contraction Hierarchies over the undirected SparseGraph. The nodes are
+// contracted one by one in the order of their importance (the edge
+// difference and the count of the contracted neighbors, updated lazily),
+// a shortcut is added between two neighbors of the contracted node unless
+// a witness path without it is found. A query is then a bidirectional
+// Dijkstra over the arcs going up in the order only, which settles just
+// a few hundred nodes even on the large maps.
+// The hierarchy is saved next to the graph snapshot, the file keeps the
+// fingerprint of the edges it was built for.
+class ContractionHierarchy {
+public:
+    struct Result {
+        // -1 when there is no path
+        Graph::T distance;
+        // From the start to the end, the shortcuts unpacked
+        vector<int> path;
+        // Both directions together
+        int settled;
+    };
+
+private:
+    // The file: the header, ranks (n), offsets (n + 1), then targets,
+    // weights and middles (arcs), all of them 32-bit
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        int32_t n;
+        int32_t arcs;
+        uint64_t fingerprint;
+    };
+    static const uint32_t VERSION;
+
+    // In the witness search, the settled nodes limit
+    const static int WITNESS_SETTLED_LIMIT;
+
+    int n;
+    uint64_t fingerprint;
+    // 0 is contracted first
+    vector<int> ranks;
+    // The upward arcs (to the higher ranks) in the CSR, each row sorted by
+    // the target. middles is the node a shortcut bypasses, -1 for the edges.
+    vector<int> offsets;
+    vector<int> targets;
+    vector<Graph::T> weights;
+    vector<int> middles;
+
+    // The query workspace, a node is reset lazily if its stamp is old
+    struct Label {
+        Graph::T distance;
+        int parent;
+        // The upward arc between the parent and the node
+        int parent_arc;
+        unsigned int stamp;
+    };
+    vector<Label> labels[2];
+    unsigned int stamp;
+
+    // The arc between the two nodes, kept in the row of the lower ranked one
+    int find_arc(int a, int b) const;
+    void unpack(int from, int to, int arc, vector<int>& path) const;
+    // The loaded arrays can be queried and unpacked safely
+    bool is_valid() const;
+
+public:
+    ContractionHierarchy();
+
+    static uint64_t get_fingerprint(const SparseGraph& graph);
+
+    // The progress is the count of the contracted nodes. False if cancelled.
+    bool build(const SparseGraph& graph, AlgorithmJob::Control* control = nullptr);
+    void clear();
+    bool is_built() const;
+
+    bool save(const string& filename) const;
+    // Fails if the file was built for another graph
+    bool load(const string& filename, const SparseGraph& graph);
+
+    // settled_nodes, if given, gets the nodes settled by the search
+    Result query(int from, int to, vector<int>* settled_nodes = nullptr);
+
+    int get_shortcuts_count() const;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "graph.h"
+#include "algorithm_job.h"
+
+#include <vector>
+
+using namespace std;
+
+// The dense sources x targets table of the shortest distances on the
+// SparseGraph, row major. There is one Dijkstra per source, stopped once all
+// the targets are settled. The sources are spread over the threads of a pool
+// kept between the calls, and every thread reuses its own workspace: the
+// distances are reset by bumping a stamp, not by refilling O(n) arrays.
+class DistanceMatrix {
+private:
+    int rows, columns;
+    vector<Graph::T> values;
+
+public:
+    const static Graph::T UNREACHABLE;
+
+    DistanceMatrix();
+
+    // False for the nodes out of the graph, or if cancelled. The progress
+    // is the count of the sources done.
+    bool compute(
+        const SparseGraph& graph, const vector<int>& sources, const vector<int>& targets,
+        AlgorithmJob::Control* control = nullptr
+    );
+
+    int get_rows() const;
+    int get_columns() const;
+    // UNREACHABLE if there is no path
+    Graph::T get(int row, int column) const;
+    const vector<Graph::T>& get_values() const;
+};
@@ -2,21 +2,40 @@
 
 #include "vec2.h"
 #include "graph.h"
+#include "quad_tree.h"
+#include "thread_pool.h"
+#include "label_cache.h"
+#include "instanced_renderer.h"
 
 #include <stddef.h>
 #include <string>
 #include <ostream>
 #include <cmath>
 #include <algorithm>
-#include <map>
-#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 using namespace std;
 
+class StepTrace;
+
 class Field {
 private:
     const static Vec2 DEF_GRAPH_LOC;
     const static float DEF_GRAPH_R;
+    const static float BARNES_HUT_THETA;
+    // The count of the points given to a worker at once
+    const static int TICK_CHUNK = 64;
+
+    const static float MIN_SCALE, MAX_SCALE;
+    // The edge labels are hidden below this zoom
+    const static float EDGE_LABELS_MIN_SCALE;
+    // The smaller nodes are drawn as squares
+    const static float MIN_ROUND_NODE_R;
+    // The node labels are hidden with more nodes on the screen
+    const static int MAX_LABELED_NODES = 400;
 
 public:
     struct FGraph: Graph
@@ -38,6 +57,7 @@ public:
 
         void add_edge(int from, int to, int weight = 1) override;
         void remove_edge(int edge_id) override;
+        void replace_edges(const vector<Edge>& new_edges) override;
 
         void clear_annotations();
     };
@@ -52,7 +72,8 @@ public:
     friend bool operator==(const Field::FGraphLink& a, const Field::FGraphLink& b);
     friend bool operator!=(const Field::FGraphLink& a, const Field::FGraphLink& b);
 
-    enum ForceType { Node, ConnectedNode, UpBound, DownBound, LeftBound, RightBound };
+    // FarNode is the long-range repulsion, used by the Barnes-Hut mode
+    enum ForceType { Node, ConnectedNode, UpBound, DownBound, LeftBound, RightBound, FarNode };
 
 private:
     bool show_options = true;
@@ -67,26 +88,162 @@ private:
     string debug_message;
 
     bool bound_forces = true;
+    bool use_barnes_hut = false;
     float scale = 1.0f;
+    // Draw the nodes and the edges with the instanced renderer, if available
+    bool use_gpu = true;
+
+    // The options the simulation reads. The UI edits its own copies and
+    // hands them over through pending_options once a frame.
+    struct TickOptions {
+        bool use_ticks;
+        bool bound_forces;
+        bool use_barnes_hut;
+        Vec2 bounds;
+    };
+    TickOptions tick_options, pending_options;
 
     bool was_middle_mouse = false;
     Vec2 middle_mouse_prev;
     Vec2 middle_mouse_shift;
 
     vector<FGraph> graphs;
-    map<int, map<int, list<FGraphLink>>> field;
+
+    // Open addressing from a cell to its dense id, only the used cells are
+    // kept, so the memory follows the points and not their bounding box.
+    // The table only grows, clear() keeps it for the next rebuild.
+    struct CellIndex {
+        // id -> cell
+        vector<pair<int, int>> cells;
+        // -1 for the empty slots
+        vector<int> slots;
+
+        CellIndex();
+        // Makes room for inserting up to count cells
+        void clear(int count);
+        // -1 if not in the index
+        int find(pair<int, int> cell) const;
+        int insert(pair<int, int> cell);
+        int get_home(pair<int, int> cell) const;
+    };
+
+    // Uniform grid over the points, hashed by the cell and rebuilt with a
+    // counting sort whenever the points have moved. The links are sorted by
+    // the cell, the cell of id c holds [offsets[c], offsets[c + 1]) of them.
+    // The link positions are also copied in the same order into xs and ys,
+    // so a cell is a contiguous run of coordinates for the batch kernel.
+    // All the arrays are reused between the rebuilds.
+    struct Grid {
+        CellIndex index;
+        vector<int> offsets;
+        vector<FGraphLink> links;
+        vector<float> xs, ys;
+        // The cell id of every indexed point, in the order of the graphs
+        vector<int> point_cells;
+
+        Grid();
+    };
+    // The points further than this from the origin cell are not indexed
+    const static int MAX_GRID_RADIUS = 512;
+
+    Grid field;
+    bool field_dirty = true;
+
+    QuadTree quad_tree;
+
+    LabelCache labels;
+
+    // Records the selection changes, while an algorithm is traced
+    StepTrace* trace = nullptr;
+    void set_point_selection(int point_id, int graph_id, const FGraph::Selection& value);
+    void set_edge_selection(int edge_id, int graph_id, const FGraph::Selection& value);
+
+    InstancedRenderer renderer;
+    vector<InstancedRenderer::NodeInstance> node_instances;
+    vector<InstancedRenderer::EdgeInstance> edge_instances;
+
+    // The forces and the moves are computed per point, each point writes
+    // only its own slot, so the result does not depend on the thread count.
+    ThreadPool pool;
+    vector<vector<Vec2>> forces;
+
+    // The simulation runs with a fixed step on its own thread (on the UI
+    // thread in update_simulation, when there are no threads). Only it writes
+    // the points; the structure of the graphs is changed under physics_mutex.
+    struct Snapshot {
+        vector<vector<Vec2>> points;
+        double time;
+
+        Snapshot();
+    };
+    // Triple buffer of the point positions: the simulation fills the back
+    // snapshot and swaps it with the latest one, the UI swaps its front one
+    // with the latest one when it is marked as new. No one waits.
+    const static int NEW_SNAPSHOT = 4;
+    // The simulation does not catch up with more steps than this at once
+    const static int MAX_CATCH_UP_STEPS = 4;
+    Snapshot snapshots[3];
+    atomic<int> latest_snapshot;
+    int back_snapshot, front_snapshot;
+
+    // The UI interpolates between the last two snapshots it got
+    Snapshot shown_prev, shown_cur;
+    vector<vector<Vec2>> shown_points;
+
+    float step_dt;
+    double step_period;
+    double next_step_time;
+    thread simulation;
+    atomic<bool> simulation_running;
+    mutex physics_mutex;
+
+    // The dragged point is held at the mouse by the simulation
+    mutex input_mutex;
+    FGraphLink dragged;
+    Vec2 dragged_point;
+    bool wake_requested;
+    condition_variable simulation_wake;
+
+    // Sleeping: a still point, which region (its cell and the adjacent ones)
+    // had no kinetic energy on the last tick and which connected points
+    // have not moved, would get the same force again, so it is skipped.
+    // When nothing moves at all, the simulation waits for wake_simulation.
+    struct EnergyMap {
+        CellIndex index;
+        // By the cell id
+        vector<float> energy;
+
+        EnergyMap();
+    };
+    EnergyMap region_energy;
+    vector<vector<char>> moved, active;
+    vector<float> graph_energy;
+    bool wake_all_points;
+    atomic<bool> converged;
+
+    bool is_region_active(pair<int, int> field_index) const;
+    void update_energy(float dt);
+
+    void simulation_step();
+    void publish_snapshot();
+    void update_shown_points();
+    void reset_shown_points();
+    void place_points(int graph_id, Vec2 point, float R);
 
     pair<int, int> get_field_index(const Vec2& point) const;
 
-    void remove_from_field(const pair<int, int>& field_index, FGraphLink point_index);
-    void add_to_field(const pair<int, int>& field_index, FGraphLink point_index);
-    void recalculate_cell_for_point(const pair<int, int>& old_field_index, FGraphLink point_index);
+    void update_field();
+    pair<const FGraphLink*, const FGraphLink*> get_cell(int x, int y) const;
+    bool is_in_field(pair<int, int> field_index) const;
 
 public:
     const float cell_size;
     Vec2 bounds;
 
     Field(float cell_size, Vec2 bounds = Vec2{500, 500});
+    Field(const Field&) = delete;
+    Field& operator=(const Field&) = delete;
+    ~Field();
 
     int add_graph(const Graph& graph, Vec2 point = DEF_GRAPH_LOC, float R = DEF_GRAPH_R);
     void remove_graph(int index);
@@ -94,6 +251,19 @@ public:
     static Vec2 def_compute_force(Vec2 delta, float force_distance, ForceType type);
     void do_tick(float dt, Vec2 (*force_function)(Vec2, float, ForceType) = &def_compute_force);
 
+    // Steps the simulation by dt every period seconds of the wall time
+    void start_simulation(float dt, double period);
+    void stop_simulation();
+    // Called once a frame before display_window
+    void update_simulation();
+    // Held while the structure of the graphs is changed from the outside,
+    // wakes the simulation
+    unique_lock<mutex> lock_physics();
+    // Wakes all the sleeping points
+    void wake_simulation();
+    bool is_converged() const;
+    float get_kinetic_energy(int graph_id) const;
+
     void display_window();
 
     void reset_points_pos(int graph_id = 0, Vec2 point = DEF_GRAPH_LOC, float R = DEF_GRAPH_R);
@@ -108,6 +278,8 @@ public:
     void disselect_edge(int edge_id, int graph_id = 0);
     void disselect_all_edges(int graph_id = 0);
 
+    void set_trace(StepTrace* trace);
+
     const vector<FGraph>& get_graphs() const;
     FGraph* get_graph(int graph_index);
 
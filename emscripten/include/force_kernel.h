@@ -0,0 +1,21 @@
+#pragma once
+
+#include "vec2.h"
+
+// Batch versions of the Field::def_compute_force terms. The points are taken
+// as the separate x and y arrays, so 4 pairs are computed at once with
+// SSE2 (native) or SIMD128 (Emscripten), and one by one elsewhere.
+namespace force_kernel {
+    // Sum of the Node forces on (x, y) from the points xs[i], ys[i], i < count,
+    // which are closer than far_distance. The coincident points are skipped.
+    Vec2 node_repulsion(
+        float x, float y, const float* xs, const float* ys, int count,
+        float force_distance, float far_distance
+    );
+
+    // Sum of the ConnectedNode forces on (x, y) from points[targets[i]], i < count.
+    Vec2 spring_attraction(
+        float x, float y, const Vec2* points, const int* targets, int count,
+        float force_distance
+    );
+}
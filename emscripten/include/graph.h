@@ -1,14 +1,39 @@
 #pragma once
 
+#include "utils.h"
+
+#include <cstdint>
 #include <vector>
 #include <set>
 #include <string>
+#include <string_view>
 #include <sstream>
-#include <regex>
 #include <map>
 
 using namespace std;
 
+// Open addressing (linear probing) hash table from the
+// undirected edge ends to the edge id.
+class EdgeIndex {
+    vector<long long> keys;
+    vector<int> ids;
+    int count;
+
+    static long long get_key(int from, int to);
+    int get_home(long long key) const;
+    void rehash(int capacity);
+
+public:
+    EdgeIndex();
+
+    int find(int from, int to) const;
+    void insert(int from, int to, int id);
+    void erase(int from, int to);
+
+    void clear();
+    void reserve(int size);
+};
+
 struct Graph
 {
     typedef int T;
@@ -35,9 +60,51 @@ struct Graph
         // Set insertion fix
         bool operator<(const Edge& b) const;
     };
-    
 
-    vector<vector<Connection>> connections;
+    // Compressed sparse row adjacency: the arcs leaving node u are
+    // [offsets[u], offsets[u + 1]) of the neighbors/weights arrays,
+    // sorted by the target node. Each undirected edge is stored as two arcs,
+    // so the weight could be changed per direction (the max flow uses it).
+    // edge_ids keeps the id of the edge of every arc (the first one for
+    // the repeated edges), so the edge id lookup is a search in the row.
+    struct Adjacency {
+        vector<int> offsets;
+        vector<int> neighbors;
+        vector<T> weights;
+        vector<int> edge_ids;
+    };
+
+    struct Arc {
+        int index;
+        int to;
+        T weight;
+    };
+
+    class ArcRange {
+        const Adjacency* adjacency;
+        int first, last;
+
+    public:
+        struct iterator {
+            const Adjacency* adjacency;
+            int index;
+
+            inline Arc operator*() const
+            { return {index, adjacency->neighbors[index], adjacency->weights[index]}; }
+            inline iterator& operator++() { index++; return *this; }
+            inline bool operator!=(const iterator& b) const { return index != b.index; }
+        };
+
+        ArcRange(const Adjacency* adjacency, int first, int last):
+            adjacency(adjacency), first(first), last(last) {}
+
+        inline iterator begin() const { return {adjacency, first}; }
+        inline iterator end() const { return {adjacency, last}; }
+        inline int size() const { return last - first; }
+    };
+
+    int n;
+    // The edge ids are dense, a removal moves the last edge into the freed id
     vector<Edge> edges;
 
     Graph();
@@ -47,14 +114,85 @@ struct Graph
 
     virtual void add_edge(int from, int to, int weight = 1);
     virtual void remove_edge(int edge_id);
+    // Replaces all the edges at once, the ids start over
+    virtual void replace_edges(const vector<Edge>& new_edges);
 
     int get_edge_id(int from, int to) const;
 
+    ArcRange neighbors(int node) const;
+    int find_arc(int from, int to) const;
+    bool is_connected(int from, int to) const;
+
+    Adjacency& get_adjacency();
+    const Adjacency& get_adjacency() const;
+    static void build_adjacency(int n, const vector<Edge>& edges, Adjacency& adjacency);
+    // Fills the edge_ids of the adjacency taken from a snapshot. False if
+    // the arcs don't match the edges: an edge without its two arcs, an arc
+    // without its edge or another weight.
+    static bool assign_edge_ids(const vector<Edge>& edges, Adjacency& adjacency);
+
     bool includes(const Graph& graph) const;
 
     string to_string() const;
     string to_info_string() const;
     static bool from_string(const string& s, Graph& graph);
+    static int parse_edges(string_view data, vector<Edge>& edges);
+
+    bool save_binary(const string& filename) const;
+    static bool load_binary(const string& filename, Graph& graph);
+
+private:
+    // The adjacency is rebuilt lazily, so a batch of add_edge/remove_edge
+    // calls costs a single O(n + m) rebuild on the next traversal.
+    mutable Adjacency adjacency;
+    mutable bool adjacency_dirty;
+
+    void update_adjacency() const;
+};
+
+// Versioned binary graph format: the header, the CSR offsets (n + 1),
+// neighbors and weights (arcs), the edges as (first, second, weight)
+// triples (m) and optionally the node coordinates as (x, y) pairs (n).
+// Every array is made of the native 32-bit values, so the loaders copy
+// them out of the memory mapped file as they are, with no parsing and no
+// adjacency rebuild. open() checks the arrays are consistent first.
+class GraphSnapshot {
+public:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t flags;
+        int32_t n;
+        int32_t m;
+        int32_t arcs;
+    };
+
+    static const uint32_t VERSION = 1;
+    static const uint32_t HAS_COORDINATES = 1;
+
+private:
+    MappedFile file;
+    const Header* header;
+
+    const int32_t* get_array(size_t offset) const;
+    bool is_valid() const;
+
+public:
+    GraphSnapshot();
+
+    bool open(const string& filename);
+
+    const Header& get_header() const;
+    const int32_t* offsets() const;
+    const int32_t* neighbors() const;
+    const int32_t* weights() const;
+    const int32_t* edges() const;
+    const float* coordinates() const;
+
+    static bool write(
+        const string& filename, int n, const vector<Graph::Edge>& edges,
+        const Graph::Adjacency& adjacency, const vector<float>* coordinates = nullptr
+    );
 };
 
 class SparseGraph {
@@ -64,15 +202,24 @@ public:
     int m;
 
 private:
-    map<pair<int, int>, Edge> edges;
+    vector<Edge> edges;
+    EdgeIndex index;
+
+    mutable Graph::Adjacency adjacency;
+    mutable bool adjacency_dirty;
+
+    void update_adjacency() const;
 
 public:
     SparseGraph();
     SparseGraph(int n, int m = 0);
     SparseGraph(int n, const vector<Edge>& edges);
 
-    bool is_connected(int from, int to);
-    Edge& get_edge(int from, int to);
+    bool is_connected(int from, int to) const;
+    int get_edge_id(int from, int to) const;
+    const Edge& get_edge(int from, int to) const;
+
+    Graph::ArcRange neighbors(int node) const;
 
     void set_edge(Edge edge);
 
@@ -80,5 +227,9 @@ public:
     string to_info_string() const;
     static bool from_string(const string& s, SparseGraph& graph);
 
-    const map<pair<int, int>, Edge> &get_edges() const;
+    bool save_binary(const string& filename, const vector<float>* coordinates = nullptr) const;
+    static bool load_binary(const string& filename, SparseGraph& graph);
+    static bool load_binary(const GraphSnapshot& snapshot, SparseGraph& graph);
+
+    const vector<Edge> &get_edges() const;
 };
\ No newline at end of file
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "imgui.h"
+#include "vec2.h"
+
+#include <vector>
+
+using namespace std;
+
+// Draws the nodes (as circles) and the edges (as lines) of a graph with the
+// instanced OpenGL 3 / WebGL 2 calls, bypassing the ImDrawList vertices.
+// The instances are kept in the field coordinates in the GPU buffers, only
+// the changed range of them is uploaded, and the field to screen transform
+// is a uniform. The drawing is a draw list callback, so it is composited
+// into the window between the draw list items added before and after it.
+// The GL objects live as long as the GL context, they are not deleted.
+class InstancedRenderer {
+public:
+    struct NodeInstance {
+        Vec2 point;
+        // In pixels
+        float radius;
+        ImU32 color;
+    };
+
+    struct EdgeInstance {
+        Vec2 from, to;
+        ImU32 color;
+        // In pixels
+        float width;
+    };
+
+private:
+    struct Batch {
+        unsigned int vertex_array;
+        unsigned int buffer;
+        int capacity;
+        int count;
+        // The copy of the uploaded instances, to find the changed range
+        vector<char> uploaded;
+
+        Batch();
+    };
+
+    // 0: not tried yet, 1: ready, -1: not supported
+    int state;
+    unsigned int node_program, edge_program;
+    Batch nodes, edges;
+    Vec2 offset, scale;
+
+    bool init();
+    void upload(Batch& batch, const void* data, int count, int size);
+    void render(const ImDrawCmd* command);
+
+    static void render_callback(const ImDrawList* draw_list, const ImDrawCmd* command);
+
+public:
+    InstancedRenderer();
+    InstancedRenderer(const InstancedRenderer&) = delete;
+    InstancedRenderer& operator=(const InstancedRenderer&) = delete;
+
+    // False, when there is no GL context or the instancing is not supported,
+    // the caller should draw through the draw list then
+    bool is_available();
+
+    void set_nodes(const vector<NodeInstance>& instances);
+    void set_edges(const vector<EdgeInstance>& instances);
+    // The screen position is offset + point * scale, the scale is per axis
+    void set_transform(Vec2 offset, Vec2 scale);
+
+    // Adds the edges, then the nodes into the draw list
+    void draw(ImDrawList* draw_list);
+};
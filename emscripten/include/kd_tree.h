@@ -0,0 +1,29 @@
+#pragma once
+
+#include "vec2.h"
+
+#include <vector>
+
+using namespace std;
+
+// Static 2-d tree over the points, for the nearest point queries. It is
+// implicit: the range [first, last) of the order has its median at the
+// middle, the smaller points on the split axis are before it and the
+// bigger ones after it, the axis alternates with the depth.
+class KdTree {
+private:
+    vector<Vec2> positions;
+    vector<int> order;
+
+    void build(int first, int last, int axis);
+
+public:
+    KdTree();
+
+    void build(const vector<Vec2>& points);
+
+    // The point nearest to the given one, with the distance measured after
+    // multiplying the coordinates by scale, or -1 when there is no point
+    // closer than max_distance. O(log n) for the spread points.
+    int nearest(const Vec2& point, const Vec2& scale, float max_distance) const;
+};
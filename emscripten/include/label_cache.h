@@ -0,0 +1,45 @@
+#pragma once
+
+#include "vec2.h"
+
+#include <vector>
+#include <string>
+
+using namespace std;
+
+// The formatted and measured text of the labels, kept per (graph, element).
+// The value is a part of the key, so a label is formatted and measured
+// again only when its value changes, and the stale entries are just
+// overwritten. Everything is dropped when the font size changes.
+class LabelCache {
+public:
+    enum Kind { NodeId, EdgeWeight, EdgeDistance, EdgeAnnotation, KINDS_COUNT };
+
+    struct Label {
+        string text;
+        Vec2 size;
+    };
+
+private:
+    struct Entry {
+        bool is_set;
+        int value;
+        Label label;
+
+        Entry();
+    };
+
+    // entries[graph_id * KINDS_COUNT + kind][element]
+    vector<vector<Entry>> entries;
+    float font_size;
+
+    Entry& get_entry(int graph_id, Kind kind, int element);
+
+public:
+    LabelCache();
+
+    const Label& get(int graph_id, Kind kind, int element, int value);
+    const Label& get(int graph_id, Kind kind, int element, const string& text);
+
+    void clear();
+};
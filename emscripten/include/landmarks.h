@@ -0,0 +1,47 @@
+#pragma once
+
+#include "graph.h"
+#include "vec2.h"
+#include "algorithm_job.h"
+
+#include <vector>
+
+using namespace std;
+
+// The ALT (A*, landmarks, triangle inequality) lower bounds: the distances
+// from a few landmarks to every node are computed once, then for any two
+// nodes max |d(L, a) - d(L, b)| over the landmarks L is a lower bound of
+// the distance between them, which is consistent, so A* stays exact.
+// The graph is undirected, so a single table per landmark serves both the
+// forward and the backward searches. The table is node major, the bound
+// reads one row of each node.
+class Landmarks {
+private:
+    const static int UNREACHABLE;
+
+    int n;
+    vector<int> nodes;
+    // distances[node * nodes.size() + i] is from the landmark i
+    vector<Graph::T> distances;
+
+    static void compute_distances(const SparseGraph& graph, int source, vector<Graph::T>& distances);
+
+public:
+    const static int DEFAULT_COUNT;
+
+    Landmarks();
+
+    // The landmarks are picked on the border of the map: the farthest nodes
+    // from the center in the count equal angle sectors. Their searches run
+    // in parallel. The progress is the count of the landmarks done, false if
+    // cancelled.
+    bool build(
+        const SparseGraph& graph, const vector<Vec2>& coordinates, int count = DEFAULT_COUNT,
+        AlgorithmJob::Control* control = nullptr
+    );
+    void clear();
+    bool is_built() const;
+
+    const vector<int>& get_nodes() const;
+    Graph::T get_lower_bound(int a, int b) const;
+};
@@ -7,6 +7,11 @@
 #define EMSCRIPTEN_CODE
 #endif
 
+// Emscripten has the threads (Web Workers) only in the pthreads build
+#if defined(__EMSCRIPTEN__) && !defined(__EMSCRIPTEN_PTHREADS__)
+#define NO_THREADS
+#endif
+
 #define FIXED_WINDOW_FLAGS ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoBackground
 #define FIXED_ALGORITHM_WINDOW_WIDTH 300
 
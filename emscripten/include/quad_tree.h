@@ -0,0 +1,73 @@
+#pragma once
+
+#include "vec2.h"
+
+#include <vector>
+
+using namespace std;
+
+// Barnes-Hut quadtree over the points. Every node keeps the mass (the count
+// of the points) and the mass center of its square, so the square that is
+// far enough could be taken as a single heavy point.
+class QuadTree {
+public:
+    struct Node {
+        Vec2 mass_center;
+        float mass;
+        Vec2 min;
+        float size;
+        // The index of the first of the 4 children, -1 for the leaves
+        int children;
+        // The point of the leaf, -1 for the empty or the merged leaves
+        int point;
+
+        Node(Vec2 min, float size);
+    };
+
+private:
+    // The coincident points are merged into a single leaf at this depth
+    const static int MAX_DEPTH = 24;
+
+    vector<Node> nodes;
+    vector<Vec2> positions;
+
+    void insert(int node, int point, int depth);
+    void split(int node);
+    // From the point to the closest point of the square, 0 inside it
+    static float get_distance(const Node& node, const Vec2& point);
+
+public:
+    QuadTree();
+
+    void build(const vector<Vec2>& points);
+
+    // Sums far_force(mass_center - point) * mass over the squares, seen from
+    // the point at an angle less than theta (size / distance), or the points.
+    // The points closer than near_radius are left out, so a square reaching
+    // into that circle is always opened down to its leaves.
+    template<typename F>
+    Vec2 accumulate(const Vec2& point, float theta, float near_radius, F far_force) const {
+        Vec2 ret;
+        if(nodes.empty()) return ret;
+        int stack[4 * MAX_DEPTH + 4];
+        int top = 0;
+        stack[top++] = 0;
+        while(top > 0) {
+            const Node& node = nodes[stack[--top]];
+            if(node.mass == 0) continue;
+            const Vec2 delta = node.mass_center - point;
+            const float distance = delta.abs();
+            if(node.children == -1) {
+                if(distance >= near_radius && distance > 1e-3f) ret += far_force(delta) * node.mass;
+                continue;
+            }
+            if(node.size < theta * distance && get_distance(node, point) >= near_radius) {
+                ret += far_force(delta) * node.mass;
+                continue;
+            }
+            for(int c = 0; c < 4; c++)
+                stack[top++] = node.children + c;
+        }
+        return ret;
+    }
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+// The buffers of the shortest path searches in algos, kept between the
+// queries: the labels of the nodes, the heaps and the list of the checked
+// nodes, for two sides (forward and backward). A label is valid only if its
+// stamp is the current one, so reset() bumps the stamps instead of clearing
+// the arrays, costing O(1) plus the nodes touched by the previous search.
+// Nothing is allocated once the buffers have grown to the graph.
+// A context serves one search at a time.
+class SearchContext {
+public:
+    // The heap is keyed by the distance plus the heuristic, the entries
+    // of the improved nodes are left in it and skipped as settled
+    using Entry = pair<double, int>;
+
+    struct Label {
+        double distance;
+        int parent;
+        int parent_edge;
+        unsigned int reached;
+        unsigned int settled;
+    };
+
+    class Side {
+    private:
+        friend class SearchContext;
+
+        vector<Label> labels;
+        vector<Entry> heap;
+        unsigned int stamp;
+
+        void reset(int n);
+
+    public:
+        Side();
+
+        inline bool is_reached(int node) const { return labels[node].reached == stamp; }
+        inline bool is_settled(int node) const { return labels[node].settled == stamp; }
+        // -1 if not reached
+        inline double get_distance(int node) const
+        { return is_reached(node) ? labels[node].distance : -1; }
+        inline int get_parent(int node) const { return is_reached(node) ? labels[node].parent : -1; }
+        inline int get_parent_edge(int node) const
+        { return is_reached(node) ? labels[node].parent_edge : -1; }
+
+        inline void reach(int node, double distance, int parent = -1, int parent_edge = -1) {
+            Label& label = labels[node];
+            label.distance = distance;
+            label.parent = parent;
+            label.parent_edge = parent_edge;
+            label.reached = stamp;
+        }
+        inline void settle(int node) { labels[node].settled = stamp; }
+
+        inline bool empty() const { return heap.empty(); }
+        inline const Entry& top() const { return heap.front(); }
+        inline void push(double key, int node) {
+            heap.push_back({key, node});
+            push_heap(heap.begin(), heap.end(), greater<Entry>());
+        }
+        inline void pop() {
+            pop_heap(heap.begin(), heap.end(), greater<Entry>());
+            heap.pop_back();
+        }
+    };
+
+private:
+    Side sides[2];
+    vector<unsigned int> checked_stamps;
+    unsigned int stamp;
+    vector<int> checked_nodes;
+
+public:
+    SearchContext();
+
+    // Before every search on a graph of n nodes
+    void reset(int n);
+
+    inline Side& get_side(int side) { return sides[side]; }
+    inline const Side& get_side(int side) const { return sides[side]; }
+
+    // The nodes checked by either side, each one once, in the check order
+    inline void check(int node) {
+        if(checked_stamps[node] == stamp) return;
+        checked_stamps[node] = stamp;
+        checked_nodes.push_back(node);
+    }
+    inline const vector<int>& get_checked_nodes() const { return checked_nodes; }
+};
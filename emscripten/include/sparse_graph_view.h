@@ -2,22 +2,71 @@
 
 #include "graph.h"
 #include "vec2.h"
+#include "instanced_renderer.h"
+#include "kd_tree.h"
+#include "contraction_hierarchy.h"
+#include "landmarks.h"
 
 using namespace std;
 
 class SparseGraphView {
 private:
+    const static float MIN_ZOOM, MAX_ZOOM;
+    // In pixels, the clicks further from the nodes pick nothing
+    const static float PICK_RADIUS;
+
     vector<int> current_path;
-    vector<bool> selected_nodes;
+    // The ids, for the drawing, and the flag of every node, for the lookup.
+    // A deselected node is dropped from the ids on the next draw.
+    enum NodeSelection : char { NOT_SELECTED, SELECTED, DESELECTED };
+    vector<int> selected_nodes;
+    vector<char> nodes_selection;
+    bool selection_dirty;
+
+    // The static edges and nodes are uploaded (or tessellated) again only
+    // after a change
+    InstancedRenderer renderer;
+    bool static_dirty;
+
+    // The draw list fallback: the static edges and nodes tessellated once at
+    // the origin, with cached_scale, and copied with an offset every frame.
+    // A chunk is a run of the vertices its indices refer to.
+    struct CachedChunk {
+        vector<ImDrawVert> vertices;
+        vector<ImDrawIdx> indices;
+    };
+    vector<CachedChunk> cached_geometry;
+    Vec2 cached_scale;
+    Vec2 cached_white_pixel;
+
+    // The camera, on top of fitting the graph into the window
+    float zoom;
+    Vec2 pan;
+
+    // For the picking and the hover, built once per load
+    KdTree nodes_index;
+    int picked_start, picked_end;
+    bool picked_changed;
+
+    void update_instances();
+    void update_cached_geometry(const ImDrawList* target, Vec2 scale);
+    void draw_cached_geometry(ImDrawList* draw_list, Vec2 offset) const;
 
 public:
     SparseGraph graph;
     vector<Vec2> coordinates;
     Vec2 bounds;
+    // Empty until built or loaded for the current graph
+    ContractionHierarchy hierarchy;
+    // For the ALT search, computed by its first run
+    Landmarks landmarks;
 
     SparseGraphView();
 
-    bool load_graph(string data, const int first_node_index = 1);
+    bool load_graph(string_view data, const int first_node_index = 1);
+    bool load_graph_file(const string& filename, const int first_node_index = 1);
+    bool save_snapshot(const string& filename) const;
+    bool load_snapshot(const string& filename);
 
     void show_window();
 
@@ -26,4 +75,8 @@ public:
     void clear_selection();
 
     float get_distance(int node_a, int node_b) const;
+
+    // The nodes clicked with the left (start) and the right (end) button,
+    // -1 if not picked. True only once after every new pick.
+    bool take_picked_nodes(int& start, int& end);
 };
\ No newline at end of file
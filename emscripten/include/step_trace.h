@@ -0,0 +1,63 @@
+#pragma once
+
+#include "field.h"
+
+#include <vector>
+
+using namespace std;
+
+// Record-once, replay-many log of the selection changes an algorithm makes
+// on the field. The algorithm is run once with the trace attached to the
+// field, marking the ends of its steps, then any step is shown by applying
+// (or reverting) the changes between it and the shown one. The full
+// selections are kept every KEYFRAME_STEPS steps, for the long jumps.
+class StepTrace {
+public:
+    using Selection = Field::FGraph::Selection;
+    enum Target { Point, Edge };
+
+    struct Event {
+        Target target;
+        int graph_id;
+        int id;
+        Selection before, after;
+    };
+
+private:
+    const static int KEYFRAME_STEPS = 256;
+
+    struct Keyframe {
+        // The count of the events applied
+        int event;
+        vector<vector<Selection>> points_sel, edges_sel;
+    };
+
+    vector<Event> events;
+    // Step k shows the events [0, step_ends[k]), the last step all of them
+    vector<int> step_ends;
+    vector<Keyframe> keyframes;
+    // The count of the events applied to the field now
+    int position;
+
+    static Keyframe take_keyframe(Field& field, int event);
+    void apply(Field& field, const Event& event, bool forward) const;
+
+public:
+    StepTrace();
+
+    void clear();
+    // Attaches the trace to the field, the selections of the field then are
+    // the starting point
+    void start(Field& field);
+    // Detaches, the field is left at the last step
+    void finish(Field& field);
+
+    // Called by the field for every selection change
+    void record(Target target, int graph_id, int id, const Selection& before, const Selection& after);
+    // Called by the algorithm at the end of every step
+    void end_step();
+
+    // The steps are [0, get_steps_count()], the last one is the finished run
+    int get_steps_count() const;
+    void seek(Field& field, int step);
+};
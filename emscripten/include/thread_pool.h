@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+using namespace std;
+
+// Fixed pool of the worker threads for the data parallel loops. The calling
+// thread takes the chunks too, so the pool of 1 thread is just a plain loop.
+// Without the threads (see NO_THREADS) everything runs on the calling thread.
+class ThreadPool {
+private:
+    struct Job {
+        const function<void(int, int)>* body;
+        int count;
+        int chunk;
+        int chunks;
+    };
+
+    vector<thread> workers;
+    mutex job_mutex;
+    condition_variable job_started, job_finished;
+
+    Job job;
+    // Incremented for every job, so the workers know they have a new one
+    unsigned long long generation;
+    atomic<int> next_chunk;
+    int running_workers;
+    bool stopping;
+
+    void run_chunks();
+    void worker_loop();
+
+public:
+    ThreadPool(int threads = 0);
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    int size() const;
+
+    // Calls body(first, last) for the [first, last) ranges of the chunk size
+    // covering [0, count). Returns after all of them are done.
+    void parallel_for(int count, int chunk, const function<void(int, int)>& body);
+};
@@ -4,6 +4,7 @@
 
 #include <stddef.h>
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <ostream>
 #include <fstream>
@@ -38,6 +39,34 @@ inline int max(int a, int b) { return a > b ? a : b; }
 
 string read_file(const string filename);
 
+// Splits the data into lines without copying them
+bool next_line(string_view data, size_t& pos, string_view& line);
+// Finds the first "a b [c]" numbers in the line, as the "(\d+)\s+(\d+)\s*(\d*)"
+// regex would do. Returns the count of the found numbers: 0, 2 or 3.
+int parse_int_tuple(string_view line, int values[3]);
+
+// Read-only memory mapping of a whole file. On the platforms
+// without mmap (Emscripten) the file is just read into memory.
+class MappedFile {
+    const char* mapped_data;
+    size_t mapped_size;
+    void* handle;
+    void* mapping;
+    string buffer;
+
+public:
+    MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool open(const string& filename);
+    void close();
+
+    const char* data() const;
+    size_t size() const;
+};
+
 ImGuiKey ImGui_ImplSDL2_KeycodeToImGuiKey(int keycode);
 
 template<typename T>
@@ -113,6 +113,15 @@ int main(int argc, char* argv[])
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
+#elif defined(IMGUI_IMPL_OPENGL_ES3)
+    // WebGL 2 (GL ES 3.0) + GLSL 300 es, for the instanced drawing. Set for
+    // the Emscripten build in CMakeLists.txt, else the ImGui backend header
+    // picks ES2 there.
+    const char *glsl_version = "#version 300 es";
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, 0);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 0);
 #elif defined(__APPLE__)
     // GL 3.2 Core + GLSL 150
     const char *glsl_version = "#version 150";
@@ -236,7 +245,7 @@ int main(int argc, char* argv[])
 
     #ifndef EMSCRIPTEN_CODE
     SparseGraphView sparseGraphView;
-    //sparseGraphView.load_graph(read_file("sparse_graph_data.txt"));
+    //sparseGraphView.load_graph_file("sparse_graph_data.txt");
     #endif
 
     // Main loop
@@ -244,6 +253,9 @@ int main(int argc, char* argv[])
     emscripten_log(EM_LOG_CONSOLE, "The main loop definition begin!");
 #endif
 
+    // The layout moves by .02 every DELTA_TICKS ms, however long the frames are
+    field.start_simulation(.02, DELTA_TICKS / 1000.);
+
     auto a = SDL_GetTicks();
 
 #ifdef __EMSCRIPTEN__
@@ -275,7 +287,7 @@ int main(int argc, char* argv[])
         ImGui::ShowDemoWindow();
         #endif
 
-        field.do_tick(.02);
+        field.update_simulation();
         field.display_window();
 
 		//ImGui::getScroll
@@ -313,6 +325,7 @@ int main(int argc, char* argv[])
     EMSCRIPTEN_MAINLOOP_END;
 #else
     // Cleanup
+    field.stop_simulation();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplSDL2_Shutdown();
     ImGui::DestroyContext();
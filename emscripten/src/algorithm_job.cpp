@@ -0,0 +1,63 @@
+#include "algorithm_job.h"
+
+#include "main.h"
+
+using namespace std;
+
+AlgorithmJob::Control::Control(): cancelled(false), progress(0) {}
+
+bool AlgorithmJob::Control::is_cancelled() const { return cancelled.load(memory_order_relaxed); }
+void AlgorithmJob::Control::add_progress(long long count) { progress.fetch_add(count, memory_order_relaxed); }
+long long AlgorithmJob::Control::get_progress() const { return progress.load(memory_order_relaxed); }
+
+void AlgorithmJob::Control::reset() {
+    cancelled = false;
+    progress = 0;
+}
+void AlgorithmJob::Control::cancel() { cancelled = true; }
+
+
+AlgorithmJob::AlgorithmJob(): control(), worker(), finished(false), running(false),
+    publish(), progress_label() {}
+
+AlgorithmJob::~AlgorithmJob() { cancel(); }
+
+void AlgorithmJob::start(const string& progress_label, Work work, Publish publish) {
+    cancel();
+    control.reset();
+    this->progress_label = progress_label;
+    this->publish = move(publish);
+    finished = false;
+    running = true;
+
+    #ifdef NO_THREADS
+    work(control);
+    finished = true;
+    #else
+    worker = thread([this, work = move(work)] {
+        work(control);
+        finished.store(true, memory_order_release);
+    });
+    #endif
+}
+
+void AlgorithmJob::cancel() {
+    control.cancel();
+    if(worker.joinable()) worker.join();
+    running = false;
+    publish = nullptr;
+}
+
+bool AlgorithmJob::poll() {
+    if(!running || !finished.load(memory_order_acquire)) return false;
+    if(worker.joinable()) worker.join();
+    running = false;
+    const Publish to_publish = move(publish);
+    publish = nullptr;
+    if(to_publish) to_publish();
+    return true;
+}
+
+bool AlgorithmJob::is_running() const { return running; }
+long long AlgorithmJob::get_progress() const { return control.get_progress(); }
+const string& AlgorithmJob::get_progress_label() const { return progress_label; }
@@ -4,6 +4,9 @@
 #include "imgui_internal.h"
 #include "misc/cpp/imgui_stdlib.h"
 #include "algorithms.tpp"
+#include "step_trace.h"
+#include "algorithm_job.h"
+#include "search_context.h"
 #include "vec2.h"
 #include "utils.h"
 #include "main.h"
@@ -14,6 +17,8 @@
 #include <regex>
 #include <fstream>
 #include <istream>
+#include <memory>
+#include <chrono>
 
 using namespace std;
 
@@ -41,6 +46,8 @@ void reset_field(Field& field) {
     field.get_graph(0)->clear_annotations();
 }
 
+// The algorithm is run once on Execute with its steps traced, moving
+// through the steps then only replays the trace
 struct steps {
     bool show;
     int max;
@@ -48,8 +55,9 @@ struct steps {
     Field& field;
     bool changed;
     bool disabled;
+    StepTrace trace;
 
-    steps(Field& field): field(field) {
+    steps(Field& field): field(field), trace() {
         reset();
     }
 
@@ -58,19 +66,69 @@ struct steps {
         changed = false;
         max = 0;
         cur = -1;
+        trace.clear();
         field.set_physics_ban(false);
     }
 
     void set_changed() {
         changed = true;
     }
-
-    void pop_changed() {
-        if(changed) changed = false;
-        else cur = -1;
-    }
 };
 
+// The same edge at every id: the ends and the weight
+bool same_edges(const vector<Graph::Edge>& a, const vector<Graph::Edge>& b) {
+    if(a.size() != b.size()) return false;
+    for(int i = 0; i < a.size(); i++)
+        if(a[i].first != b[i].first || a[i].second != b[i].second ||
+            a[i].weight != b[i].weight) { return false; }
+    return true;
+}
+
+// The sparse graph is read in place by the job, so its adjacency is built
+// here, on the UI thread, and the loads cancel the job before changing it
+template<typename Search>
+void start_sparse_search(AlgorithmJob& job, SparseGraphView& view, string& log, Search search) {
+    if(view.graph.n > 0) view.graph.neighbors(0);
+
+    auto ss = make_shared<stringstream>();
+    auto res = make_shared<algos::bidirect_result>();
+    log.clear();
+    job.start("nodes settled",
+        [&view, search, ss, res](AlgorithmJob::Control& control) {
+            *res = search(view, ss.get(), control);
+        },
+        [&view, &log, ss, res]() {
+            log = ss->str();
+
+            view.clear_selection();
+            view.set_current_path(res->path);
+            for(int node : res->checked_nodes)
+                view.set_node_selection(node, true);
+        }
+    );
+}
+
+// Fast enough to be run right away, the hierarchy is built already
+string query_hierarchy(SparseGraphView& view, int from, int to) {
+    vector<int> settled_nodes;
+    const auto start = chrono::steady_clock::now();
+    const auto res = view.hierarchy.query(from, to, &settled_nodes);
+    const auto time = chrono::duration_cast<chrono::microseconds>(
+        chrono::steady_clock::now() - start).count();
+
+    view.clear_selection();
+    view.set_current_path(res.path);
+    for(int node : settled_nodes)
+        view.set_node_selection(node, true);
+
+    stringstream ss;
+    ss << "The distance: " << res.distance << "\n";
+    ss << "Number of settled nodes: " << res.settled << "\n";
+    ss << "The query time: " << time << " us\n";
+    ss << "Shortcuts in the hierarchy: " << view.hierarchy.get_shortcuts_count() << "\n";
+    return ss.str();
+}
+
 void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
     const ImGuiViewport* main_viewport = ImGui::GetMainViewport();
 
@@ -97,6 +155,15 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
 
     static steps steps(field);
 
+    // The max flow and the sparse graph searches run in the background.
+    // The loads cancel the job first, the sparse graph it reads must stay.
+    static AlgorithmJob job;
+    static string log = "";
+    job.poll();
+    // The search buffers are kept between the runs, the sparse one is
+    // used by the job only
+    static SearchContext field_context, sparse_context;
+
     static bool execute_requested = false;
     static string graph_data = field.get_graph(0)->to_string();
     static string graph_description = field.get_graph(0)->to_info_string();
@@ -104,22 +171,19 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
     if (ImGui::TreeNode("Change graph"))
     {
         if (ImGui::Button("Load")) {
+            job.cancel();
             Graph buff;
             if(Graph::from_string(graph_data, buff)){
                 graph_description = buff.to_info_string();
 
                 Graph& cur_graph = *field.get_graph(0);
                 if(cur_graph.includes(buff) || (buff.includes(cur_graph) && 
-                    buff.connections.size() == cur_graph.connections.size())
+                    buff.n == cur_graph.n)
                 ) {
-                    for(int i = cur_graph.edges.size() - 1; i >= 0; i--)
-                        cur_graph.remove_edge(i);
-                    for(int i = 0; i < buff.edges.size(); i++)
-                        cur_graph.add_edge(
-                            buff.edges[i].first,
-                            buff.edges[i].second,
-                            buff.edges[i].weight
-                        );
+                    auto lock = field.lock_physics();
+                    cur_graph.replace_edges(buff.edges);
+                    // Rebuilt here, so the simulation only reads it
+                    cur_graph.get_adjacency();
                 }
                 else {
                     field.remove_graph(0);
@@ -134,11 +198,22 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
         if (sparseGraphView != nullptr) {
             ImGui::SameLine();
             if (ImGui::Button("Load headless")) {
-                string graph_data = read_file("sparse_graph_data.txt");
-                if(sparseGraphView->load_graph(graph_data)) {
+                job.cancel();
+                // The binary snapshot is preferred, as it needs no parsing
+                if(sparseGraphView->load_snapshot("sparse_graph_data.bin") ||
+                    sparseGraphView->load_graph_file("sparse_graph_data.txt")
+                ) {
                     graph_description = sparseGraphView->graph.to_info_string();
+                    // Used only if built for this very graph
+                    sparseGraphView->hierarchy.load("sparse_graph_data.ch", sparseGraphView->graph);
                 }
             }
+            ImGui::SameLine();
+            if (ImGui::Button("Save snapshot")) {
+                sparseGraphView->save_snapshot("sparse_graph_data.bin");
+                if(sparseGraphView->hierarchy.is_built())
+                    sparseGraphView->hierarchy.save("sparse_graph_data.ch");
+            }
         }
 
         ImGui::InputTextMultiline(
@@ -161,7 +236,6 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
     }
 
     static bool incorrect_input = false;
-    static string log = "";
 
     // Algortithms ComboBox
     static const vector<string> algorithms{
@@ -171,9 +245,13 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
         #ifndef EMSCRIPTEN_CODE
         "7. Bidirect Dijkstra's min path",
         "8. Bidirect A* min path",
+        "9. Contraction hierarchies min path",
+        "10. Bidirect ALT min path",
         #endif
     };
-    static int item_current_idx = algorithms.size() - 1;
+    // "8. Bidirect A* min path" (or the last one on the web) stays the default,
+    // the entries added after it build their indices on the first run
+    static int item_current_idx = min((int) algorithms.size() - 1, 7);
     static int item_prev_idx = -1;
     if (ImGui::BeginCombo("Algorithm", algorithms[item_current_idx].c_str()))
     {
@@ -201,6 +279,7 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
         ImGui::EndCombo();
     }
     if(item_current_idx != item_prev_idx) {
+        job.cancel();
         steps.reset();
         item_prev_idx = item_current_idx;
         steps.disabled = item_current_idx > 4;
@@ -208,31 +287,40 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
 
     // Algortithm control
     static string from_node_str = to_string(1);
-    static string to_node_str = to_string(field.get_graph(0)->connections.size() - 1);
+    static string to_node_str = to_string(field.get_graph(0)->n - 1);
 
     ImGui::Dummy({0, 10});
     if(incorrect_input) ImGui::TextColored(ImVec4(1, 0, 0, 1), "Incorrect input data!");
-    if(ImGui::Button("Execute") || execute_requested || steps.changed) {
-        steps.pop_changed();
+    if(steps.changed) {
+        steps.changed = false;
+        steps.trace.seek(field, steps.cur);
+    }
+    ImGui::BeginDisabled(job.is_running());
+    const bool execute_pressed = ImGui::Button("Execute");
+    ImGui::EndDisabled();
+    if((execute_pressed || execute_requested) && !job.is_running()) {
         execute_requested = false;
 
         incorrect_input = false;
         reset_field(field);
+        steps.trace.clear();
+        const bool traced = !steps.disabled;
+        if(traced) steps.trace.start(field);
 
         if(item_current_idx == 0) {
-            algos::bfs(field, 0, 0, &steps.max, steps.cur);
+            algos::bfs(field, 0, 0, &steps.trace);
         }
         else if(item_current_idx == 1) {
-            algos::dfs(field, 0, 0, &steps.max, steps.cur);
+            algos::dfs(field, 0, 0, &steps.trace);
         }
         else if(item_current_idx == 2) {
-            algos::prims_min_tree(field, 0, 0, &steps.max, steps.cur);
+            algos::prims_min_tree(field, 0, 0, &steps.trace);
         }
         else if(item_current_idx == 3) {
             int from = -1, to = -1;
             if(!get_int(from_node_str, from) || !get_int(to_node_str, to))
                 incorrect_input = true;
-            else algos::dijkstra_path(field, 0, from, to, &steps.max, steps.cur);
+            else algos::dijkstra_path(field, 0, from, to, &steps.trace, &field_context);
         }
         else if(item_current_idx == 4) {
             int from = -1, to = -1;
@@ -242,7 +330,7 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
                 Graph& graph = *field.get_graph(0);
                 stringstream log_stream;
                 log_stream<<"The checked nodes:\n";
-                algos::astar_path(field, 0, from, to, &log_stream, &steps.max, steps.cur);
+                algos::astar_path(field, 0, from, to, &log_stream, &steps.trace, &field_context);
                 log = log_stream.str();
             }
         }
@@ -251,24 +339,38 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
             if(!get_int(from_node_str, from) || !get_int(to_node_str, to))
                 incorrect_input = true;
             else {
-                auto& graph = *field.get_graph(0);
-                auto res = algos::ff_max_flow(field, 0, from, to);
-                stringstream log_stream;
-                log_stream << "The maximum flow: " << res.maxFlow;
-                log = log_stream.str();
-
-                field.select_point(from, 0, ImColor(1.0f, .0f, .0f, 1.0f));
-                field.select_point(to, 0, ImColor(.0f, 1.0f, .0f, 1.f));
-                const int n = graph.connections.size();
-                for(int i = 0; i < n; i++)
-                for(int j = 0; j < n; j++){
-                    if(i >= j || !res.flowData.connections[i][j].connected)
-                        continue;
-                    stringstream builder;
-                    builder << graph.connections[i][j].weight << "/" <<
-                        min(res.flowData.connections[j][i].weight, res.flowData.connections[i][j].weight);
-                    graph.edges_anno[graph.get_edge_id(i, j)] = builder.str();
-                }
+                // The work gets a copy, the field graph is free to change
+                auto graph = make_shared<Graph>(*field.get_graph(0));
+                auto res = make_shared<algos::FFMaxFlowRes>(Graph());
+                log.clear();
+                job.start("augmenting paths",
+                    [graph, res, from, to](AlgorithmJob::Control& control) {
+                        *res = algos::ff_max_flow(*graph, from, to, &control);
+                    },
+                    [&field, graph, res, from, to]() {
+                        stringstream log_stream;
+                        log_stream << "The maximum flow: " << res->maxFlow;
+                        log = log_stream.str();
+
+                        auto& cur_graph = *field.get_graph(0);
+                        // The annotations go by the edge ids, so the edges
+                        // have to be the very same, in the same order
+                        if(cur_graph.n != graph->n || !same_edges(cur_graph.edges, graph->edges))
+                            return;
+                        field.select_point(from, 0, ImColor(1.0f, .0f, .0f, 1.0f));
+                        field.select_point(to, 0, ImColor(.0f, 1.0f, .0f, 1.f));
+                        const auto& flow = res->flowData.get_adjacency();
+                        const int m = graph->edges.size();
+                        for(int e = 0; e < m; e++){
+                            const int i = graph->edges[e].first;
+                            const int j = graph->edges[e].second;
+                            stringstream builder;
+                            builder << graph->edges[e].weight << "/" <<
+                                min(flow.weights[res->flowData.find_arc(j, i)], flow.weights[res->flowData.find_arc(i, j)]);
+                            cur_graph.edges_anno[e] = builder.str();
+                        }
+                    }
+                );
             }
         }
         else if(sparseGraphView == nullptr) { 
@@ -279,14 +381,10 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
             if(!get_int(from_node_str, from) || !get_int(to_node_str, to))
                 incorrect_input = true;
             else {
-                stringstream ss;
-                auto res = algos::bidirect_dijkstra_path(sparseGraphView->graph, from, to, &ss);
-                log = ss.str();
-
-                sparseGraphView->clear_selection();
-                sparseGraphView->set_current_path(res.path);
-                for(int node : res.checked_nodes)
-                    sparseGraphView->set_node_selection(node, true);
+                start_sparse_search(job, *sparseGraphView, log,
+                    [from, to](SparseGraphView& view, ostream* ss, AlgorithmJob::Control& control)
+                    { return algos::bidirect_dijkstra_path(view.graph, from, to, ss, &control, &sparse_context); }
+                );
             }
         }
         else if(item_current_idx == 7) {
@@ -294,20 +392,65 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
             if(!get_int(from_node_str, from) || !get_int(to_node_str, to))
                 incorrect_input = true;
             else {
-                stringstream ss;
-                auto res = algos::bidirect_astar_path(*sparseGraphView, from, to, &ss);
-                log = ss.str();
-
-                sparseGraphView->clear_selection();
-                sparseGraphView->set_current_path(res.path);
-                for(int node : res.checked_nodes)
-                    sparseGraphView->set_node_selection(node, true);
+                start_sparse_search(job, *sparseGraphView, log,
+                    [from, to](SparseGraphView& view, ostream* ss, AlgorithmJob::Control& control)
+                    { return algos::bidirect_astar_path(view, from, to, ss, &control, nullptr, &sparse_context); }
+                );
             }
         }
 
-        if(steps.cur < 0) {
-            steps.cur = steps.max;
+        else if(item_current_idx == 8) {
+            int from = -1, to = -1;
+            if(!get_int(from_node_str, from) || !get_int(to_node_str, to))
+                incorrect_input = true;
+            else if(sparseGraphView->hierarchy.is_built())
+                log = query_hierarchy(*sparseGraphView, from, to);
+            else {
+                // The preprocessing is done once per graph, in the background,
+                // and saved next to the snapshot
+                SparseGraphView& view = *sparseGraphView;
+                if(view.graph.n > 0) view.graph.neighbors(0);
+                auto hierarchy = make_shared<ContractionHierarchy>();
+                log.clear();
+                job.start("nodes contracted",
+                    [&view, hierarchy](AlgorithmJob::Control& control) {
+                        hierarchy->build(view.graph, &control);
+                    },
+                    [&view, hierarchy, from, to]() {
+                        view.hierarchy = move(*hierarchy);
+                        view.hierarchy.save("sparse_graph_data.ch");
+                        log = query_hierarchy(view, from, to);
+                    }
+                );
+            }
         }
+
+        else if(item_current_idx == 9) {
+            int from = -1, to = -1;
+            if(!get_int(from_node_str, from) || !get_int(to_node_str, to))
+                incorrect_input = true;
+            else {
+                // The job writes the landmarks of the view, nothing else
+                // touches them while it runs
+                start_sparse_search(job, *sparseGraphView, log,
+                    [from, to](SparseGraphView& view, ostream* ss, AlgorithmJob::Control& control) {
+                        if(!view.landmarks.is_built() &&
+                            !view.landmarks.build(view.graph, view.coordinates, Landmarks::DEFAULT_COUNT, &control)
+                        ) { return algos::bidirect_result(); }
+
+                        *ss << "Landmarks: " << view.landmarks.get_nodes().size() << "\n";
+                        return algos::bidirect_astar_path(view, from, to, ss, &control, &view.landmarks,
+                            &sparse_context);
+                    }
+                );
+            }
+        }
+
+        if(traced) {
+            steps.trace.finish(field);
+            steps.max = steps.trace.get_steps_count();
+        }
+        steps.cur = steps.max;
     }
 
     ImGui::SameLine();
@@ -317,6 +460,19 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
     }
     ImGui::EndDisabled();
 
+    if(job.is_running()) {
+        ImGui::Text("Running: %lld %s", job.get_progress(), job.get_progress_label().c_str());
+        ImGui::SameLine();
+        if(ImGui::Button("Cancel")) job.cancel();
+    }
+
+    // The nodes clicked in the sparse graph view
+    int picked_start, picked_end;
+    if(sparseGraphView != nullptr && sparseGraphView->take_picked_nodes(picked_start, picked_end)) {
+        if(picked_start != -1) from_node_str = to_string(picked_start);
+        if(picked_end != -1) to_node_str = to_string(picked_end);
+    }
+
     switch (item_current_idx)
     {
     case 3:
@@ -324,6 +480,8 @@ void display_algorithms_window(Field& field, SparseGraphView* sparseGraphView) {
     case 5:
     case 6:
     case 7:
+    case 8:
+    case 9:
         const float x = ImGui::GetContentRegionAvail().x / 2 - 10;
         ImGui::SetNextItemWidth(x - ImGui::CalcTextSize("Start point").x);
         ImGui::InputText("Start point", &from_node_str, ImGuiInputTextFlags_CharsDecimal);
@@ -0,0 +1,425 @@
+#include "contraction_hierarchy.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <queue>
+#include <functional>
+
+using namespace std;
+
+const uint32_t ContractionHierarchy::VERSION = 2;
+const int ContractionHierarchy::WITNESS_SETTLED_LIMIT = 60;
+
+namespace {
+    using T = Graph::T;
+    const T INFINITE_DISTANCE = numeric_limits<T>::max();
+
+    using Queue = priority_queue<pair<T, int>, vector<pair<T, int>>, greater<pair<T, int>>>;
+
+    // The arcs of the graph still being contracted, both ends keep one
+    struct DynamicArc {
+        int to;
+        T weight;
+        int middle;
+    };
+
+    struct Shortcut {
+        int from, to;
+        T weight;
+    };
+
+    // The Dijkstra from a neighbor of the contracted node, which doesn't go
+    // through it. The distances are reset lazily by the stamps.
+    class WitnessSearch {
+        vector<T> distances;
+        vector<unsigned int> stamps;
+        unsigned int stamp;
+        Queue queue;
+
+    public:
+        WitnessSearch(int n): distances(n), stamps(n, 0), stamp(0), queue() {}
+
+        void run(
+            const vector<vector<DynamicArc>>& arcs, int source, int skipped,
+            T max_distance, int settled_limit
+        ) {
+            stamp++;
+            queue = Queue();
+            distances[source] = 0;
+            stamps[source] = stamp;
+            queue.push({0, source});
+            int settled = 0;
+            while(!queue.empty() && settled < settled_limit) {
+                const auto [distance, node] = queue.top();
+                queue.pop();
+                if(distance > distances[node]) continue;
+                if(distance > max_distance) break;
+                settled++;
+
+                for(const auto& arc : arcs[node]) {
+                    if(arc.to == skipped) continue;
+                    const T next = distance + arc.weight;
+                    if(stamps[arc.to] != stamp || next < distances[arc.to]) {
+                        distances[arc.to] = next;
+                        stamps[arc.to] = stamp;
+                        queue.push({next, arc.to});
+                    }
+                }
+            }
+        }
+
+        T get_distance(int node) const
+        { return stamps[node] == stamp ? distances[node] : INFINITE_DISTANCE; }
+    };
+
+    // The shortcuts the contraction of the node needs
+    void find_shortcuts(
+        const vector<vector<DynamicArc>>& arcs, int node, WitnessSearch& search,
+        int settled_limit, vector<Shortcut>& shortcuts
+    ) {
+        shortcuts.clear();
+        const auto& node_arcs = arcs[node];
+        T max_out = 0;
+        for(const auto& arc : node_arcs) max_out = max(max_out, arc.weight);
+
+        for(int i = 0; i < node_arcs.size(); i++) {
+            const DynamicArc& in = node_arcs[i];
+            search.run(arcs, in.to, node, in.weight + max_out, settled_limit);
+            for(int j = i + 1; j < node_arcs.size(); j++) {
+                const DynamicArc& out = node_arcs[j];
+                const T via = in.weight + out.weight;
+                if(search.get_distance(out.to) > via)
+                    shortcuts.push_back({in.to, out.to, via});
+            }
+        }
+    }
+
+    void set_arc(vector<DynamicArc>& node_arcs, int to, T weight, int middle) {
+        for(auto& arc : node_arcs) {
+            if(arc.to != to) continue;
+            if(weight < arc.weight) arc = {to, weight, middle};
+            return;
+        }
+        node_arcs.push_back({to, weight, middle});
+    }
+}
+
+ContractionHierarchy::ContractionHierarchy(): n(0), fingerprint(0), ranks(), offsets(),
+    targets(), weights(), middles(), labels(), stamp(0) {}
+
+uint64_t ContractionHierarchy::get_fingerprint(const SparseGraph& graph) {
+    // FNV-1a over n and the edges in their order
+    uint64_t hash = 14695981039346656037ull;
+    const auto add = [&](uint32_t value) {
+        for(int i = 0; i < 4; i++) {
+            hash ^= (value >> (8 * i)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    };
+    add(graph.n);
+    for(const auto& edge : graph.get_edges()) {
+        add(edge.first);
+        add(edge.second);
+        add(edge.weight);
+    }
+    return hash;
+}
+
+bool ContractionHierarchy::build(const SparseGraph& graph, AlgorithmJob::Control* control) {
+    clear();
+    const int n = graph.n;
+
+    vector<vector<DynamicArc>> arcs(n);
+    for(int node = 0; node < n; node++) {
+        for(const auto arc : graph.neighbors(node)) {
+            if(arc.to == node) continue;
+            set_arc(arcs[node], arc.to, arc.weight, -1);
+        }
+    }
+
+    WitnessSearch search(n);
+    vector<Shortcut> shortcuts;
+    vector<int> contracted_neighbors(n, 0);
+    const auto get_priority = [&](int node) {
+        find_shortcuts(arcs, node, search, WITNESS_SETTLED_LIMIT, shortcuts);
+        return (int) shortcuts.size() - (int) arcs[node].size() + contracted_neighbors[node];
+    };
+
+    // The entries of the changed priorities are left in the queue, skipped
+    // as they no longer match the priorities
+    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> order;
+    vector<int> priorities(n);
+    for(int node = 0; node < n; node++) {
+        priorities[node] = get_priority(node);
+        order.push({priorities[node], node});
+    }
+
+    vector<int> new_ranks(n, -1);
+    vector<vector<DynamicArc>> upward(n);
+    int rank = 0;
+    while(!order.empty()) {
+        if(control != nullptr) {
+            if(control->is_cancelled()) return false;
+        }
+        const auto [queued_priority, node] = order.top();
+        order.pop();
+        if(new_ranks[node] != -1 || queued_priority != priorities[node]) continue;
+
+        // The lazy update: a node got more important is put back
+        const int priority = get_priority(node);
+        if(!order.empty() && priority > order.top().first) {
+            priorities[node] = priority;
+            order.push({priority, node});
+            continue;
+        }
+
+        // shortcuts are the ones of this node, after get_priority
+        new_ranks[node] = rank++;
+        if(control != nullptr) control->add_progress();
+        for(const auto& arc : arcs[node]) {
+            auto& other = arcs[arc.to];
+            other.erase(find_if(other.begin(), other.end(),
+                [node](const DynamicArc& a) { return a.to == node; }));
+            contracted_neighbors[arc.to]++;
+        }
+        for(const auto& shortcut : shortcuts) {
+            set_arc(arcs[shortcut.from], shortcut.to, shortcut.weight, node);
+            set_arc(arcs[shortcut.to], shortcut.from, shortcut.weight, node);
+        }
+        upward[node] = move(arcs[node]);
+        arcs[node] = {};
+
+        // The neighbors are the ones to change
+        for(const auto& arc : upward[node]) {
+            const int priority = get_priority(arc.to);
+            if(priority == priorities[arc.to]) continue;
+            priorities[arc.to] = priority;
+            order.push({priority, arc.to});
+        }
+    }
+
+    this->n = n;
+    fingerprint = get_fingerprint(graph);
+    ranks = move(new_ranks);
+    offsets.assign(n + 1, 0);
+    for(int node = 0; node < n; node++) {
+        auto& row = upward[node];
+        sort(row.begin(), row.end(),
+            [](const DynamicArc& a, const DynamicArc& b) { return a.to < b.to; });
+        offsets[node + 1] = offsets[node] + row.size();
+        for(const auto& arc : row) {
+            targets.push_back(arc.to);
+            weights.push_back(arc.weight);
+            middles.push_back(arc.middle);
+        }
+    }
+    labels[0].assign(n, {0, -1, -1, 0});
+    labels[1].assign(n, {0, -1, -1, 0});
+    return true;
+}
+
+void ContractionHierarchy::clear() {
+    n = 0;
+    fingerprint = 0;
+    ranks.clear();
+    offsets.clear();
+    targets.clear();
+    weights.clear();
+    middles.clear();
+    labels[0].clear();
+    labels[1].clear();
+    stamp = 0;
+}
+
+bool ContractionHierarchy::is_built() const { return !offsets.empty(); }
+
+bool ContractionHierarchy::save(const string& filename) const {
+    if(offsets.empty()) return false;
+    Header header = {{'C', 'H', 'R', 'C'}, VERSION, n, (int32_t) targets.size(), fingerprint};
+
+    ofstream file(filename, ios::binary);
+    if(!file) return false;
+    const auto write_array = [&](const void* data, size_t size) {
+        if(size > 0) file.write(static_cast<const char*>(data), size);
+    };
+    write_array(&header, sizeof(Header));
+    write_array(ranks.data(), sizeof(int32_t) * ranks.size());
+    write_array(offsets.data(), sizeof(int32_t) * offsets.size());
+    write_array(targets.data(), sizeof(int32_t) * targets.size());
+    write_array(weights.data(), sizeof(int32_t) * weights.size());
+    write_array(middles.data(), sizeof(int32_t) * middles.size());
+    return file.good();
+}
+
+bool ContractionHierarchy::load(const string& filename, const SparseGraph& graph) {
+    MappedFile file;
+    if(!file.open(filename) || file.size() < sizeof(Header)) return false;
+
+    const Header& header = *reinterpret_cast<const Header*>(file.data());
+    if(string_view(header.magic, 4) != "CHRC" || header.version != VERSION) return false;
+    if(header.n != graph.n || header.arcs < 0) return false;
+    if(header.fingerprint != get_fingerprint(graph)) return false;
+
+    const size_t n = header.n, arcs = header.arcs;
+    if(file.size() != sizeof(Header) + sizeof(int32_t) * (2 * n + 1 + 3 * arcs)) return false;
+    const int32_t* data = reinterpret_cast<const int32_t*>(file.data() + sizeof(Header));
+    if(data[n] != 0 || data[2 * n] != header.arcs) return false;
+
+    clear();
+    this->n = header.n;
+    fingerprint = header.fingerprint;
+    ranks.assign(data, data + n);
+    offsets.assign(data + n, data + 2 * n + 1);
+    data += 2 * n + 1;
+    targets.assign(data, data + arcs);
+    weights.assign(data + arcs, data + 2 * arcs);
+    middles.assign(data + 2 * arcs, data + 3 * arcs);
+    // The fingerprint matches the graph, not the contents, a damaged file
+    // is rebuilt instead
+    if(!is_valid()) {
+        clear();
+        return false;
+    }
+    labels[0].assign(n, {0, -1, -1, 0});
+    labels[1].assign(n, {0, -1, -1, 0});
+    return true;
+}
+
+bool ContractionHierarchy::is_valid() const {
+    // The ranks are a permutation
+    vector<bool> used(n);
+    for(const int rank : ranks) {
+        if(rank < 0 || rank >= n || used[rank]) return false;
+        used[rank] = true;
+    }
+
+    // The rows are monotone, sorted by the target and going up only
+    if(offsets[0] != 0 || offsets[n] != (int) targets.size()) return false;
+    for(int node = 0; node < n; node++) {
+        if(offsets[node + 1] < offsets[node]) return false;
+        for(int arc = offsets[node]; arc < offsets[node + 1]; arc++) {
+            const int to = targets[arc];
+            if(to < 0 || to >= n || ranks[to] <= ranks[node] || weights[arc] < 0) return false;
+            if(arc > offsets[node] && to <= targets[arc - 1]) return false;
+        }
+    }
+
+    // A middle is below both ends and has both halves, so the unpacking
+    // goes down in the ranks and ends
+    for(int node = 0; node < n; node++) {
+        for(int arc = offsets[node]; arc < offsets[node + 1]; arc++) {
+            const int middle = middles[arc];
+            if(middle == -1) continue;
+            if(middle < 0 || middle >= n || ranks[middle] >= ranks[node]) return false;
+            if(find_arc(middle, node) == -1 || find_arc(middle, targets[arc]) == -1) return false;
+        }
+    }
+    return true;
+}
+
+int ContractionHierarchy::find_arc(int a, int b) const {
+    // The arc is kept by the lower of the two
+    if(ranks[a] > ranks[b]) swap(a, b);
+    const auto first = targets.begin() + offsets[a], last = targets.begin() + offsets[a + 1];
+    const auto it = lower_bound(first, last, b);
+    return it != last && *it == b ? it - targets.begin() : -1;
+}
+
+void ContractionHierarchy::unpack(int from, int to, int arc, vector<int>& path) const {
+    // Appends the path without its first node
+    const int middle = middles[arc];
+    if(middle == -1) {
+        path.push_back(to);
+        return;
+    }
+    unpack(from, middle, find_arc(from, middle), path);
+    unpack(middle, to, find_arc(middle, to), path);
+}
+
+ContractionHierarchy::Result ContractionHierarchy::query(int from, int to, vector<int>* settled_nodes) {
+    Result result{-1, {}, 0};
+    if(from < 0 || to < 0 || from >= n || to >= n) return result;
+
+    if(++stamp == 0) {
+        for(auto& side : labels)
+            for(auto& label : side) label.stamp = 0;
+        stamp = 1;
+    }
+    const auto is_reached = [&](int side, int node) { return labels[side][node].stamp == stamp; };
+
+    Queue queues[2];
+    labels[0][from] = {0, -1, -1, stamp};
+    labels[1][to] = {0, -1, -1, stamp};
+    queues[0].push({0, from});
+    queues[1].push({0, to});
+
+    T best = INFINITE_DISTANCE;
+    int meeting = -1;
+    for(int side = 0; !queues[0].empty() || !queues[1].empty(); side ^= 1) {
+        Queue& queue = queues[side];
+        if(queue.empty()) continue;
+        const auto [distance, node] = queue.top();
+        queue.pop();
+        if(distance > labels[side][node].distance) continue;
+        // Nothing shorter is found on this side anymore
+        if(distance >= best) {
+            queue = Queue();
+            continue;
+        }
+
+        result.settled++;
+        if(settled_nodes != nullptr) settled_nodes->push_back(node);
+        if(is_reached(side ^ 1, node)) {
+            const T total = distance + labels[side ^ 1][node].distance;
+            if(total < best) {
+                best = total;
+                meeting = node;
+            }
+        }
+
+        // Stall on demand: the graph is undirected, so the arcs up are the
+        // ones down as well, a node reached shorter from above is not
+        // on a shortest path and is not expanded
+        bool stalled = false;
+        for(int arc = offsets[node]; arc < offsets[node + 1] && !stalled; arc++) {
+            const Label& label = labels[side][targets[arc]];
+            stalled = label.stamp == stamp && label.distance + weights[arc] < distance;
+        }
+        if(stalled) continue;
+
+        for(int arc = offsets[node]; arc < offsets[node + 1]; arc++) {
+            const int next = targets[arc];
+            const T next_distance = distance + weights[arc];
+            Label& label = labels[side][next];
+            if(label.stamp != stamp || next_distance < label.distance) {
+                label = {next_distance, node, arc, stamp};
+                queue.push({next_distance, next});
+            }
+        }
+    }
+
+    if(meeting == -1) return result;
+    result.distance = best;
+
+    // Up from the start to the meeting node, then down to the end
+    vector<int> up;
+    for(int node = meeting; node != from; node = labels[0][node].parent) up.push_back(node);
+    up.push_back(from);
+    reverse(up.begin(), up.end());
+
+    result.path.push_back(from);
+    for(int i = 1; i < up.size(); i++)
+        unpack(up[i - 1], up[i], labels[0][up[i]].parent_arc, result.path);
+    for(int node = meeting; node != to; node = labels[1][node].parent)
+        unpack(node, labels[1][node].parent, labels[1][node].parent_arc, result.path);
+    return result;
+}
+
+int ContractionHierarchy::get_shortcuts_count() const {
+    int count = 0;
+    for(const int middle : middles) count += middle != -1;
+    return count;
+}
@@ -43,7 +43,7 @@ void display_control_window(Field& field) {
             ImGui::TableNextRow();
             ImGui::TableNextColumn();
 
-            const int n = graphs[g].connections.size();
+            const int n = graphs[g].n;
             const int m = graphs[g].edges.size();
 
             const static ImGuiTreeNodeFlags tree_node_flags = 
@@ -0,0 +1,122 @@
+#include "distance_matrix.h"
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <functional>
+
+using namespace std;
+
+const Graph::T DistanceMatrix::UNREACHABLE = -1;
+
+namespace {
+    using T = Graph::T;
+
+    // Kept by every thread between the calls, so the repeated tables cost
+    // no allocations once the arrays have grown to the graph
+    struct Workspace {
+        vector<T> distances;
+        vector<unsigned int> stamps;
+        unsigned int stamp = 0;
+        vector<pair<T, int>> heap;
+
+        void reset(int n) {
+            if(stamps.size() != n) {
+                distances.assign(n, 0);
+                stamps.assign(n, 0);
+                stamp = 0;
+            }
+            if(++stamp == 0) {
+                fill(stamps.begin(), stamps.end(), 0);
+                stamp = 1;
+            }
+            heap.clear();
+        }
+
+        inline bool is_reached(int node) const { return stamps[node] == stamp; }
+    };
+    thread_local Workspace workspace;
+
+    // The workers live as long as the program, so do their workspaces
+    ThreadPool& get_pool() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    // target_counts[node] is how many times the node is among the targets
+    void search(
+        const SparseGraph& graph, int source, const vector<int>& target_counts,
+        int distinct_targets, Workspace& ws
+    ) {
+        ws.reset(graph.n);
+        const auto greater_pair = greater<pair<T, int>>();
+        ws.distances[source] = 0;
+        ws.stamps[source] = ws.stamp;
+        ws.heap.push_back({0, source});
+
+        int remaining = distinct_targets;
+        while(!ws.heap.empty() && remaining > 0) {
+            pop_heap(ws.heap.begin(), ws.heap.end(), greater_pair);
+            const auto [distance, node] = ws.heap.back();
+            ws.heap.pop_back();
+            if(distance > ws.distances[node]) continue;
+            if(target_counts[node] > 0) remaining--;
+
+            for(const auto arc : graph.neighbors(node)) {
+                const T next = distance + arc.weight;
+                if(!ws.is_reached(arc.to) || next < ws.distances[arc.to]) {
+                    ws.distances[arc.to] = next;
+                    ws.stamps[arc.to] = ws.stamp;
+                    ws.heap.push_back({next, arc.to});
+                    push_heap(ws.heap.begin(), ws.heap.end(), greater_pair);
+                }
+            }
+        }
+    }
+}
+
+DistanceMatrix::DistanceMatrix(): rows(0), columns(0), values() {}
+
+bool DistanceMatrix::compute(
+    const SparseGraph& graph, const vector<int>& sources, const vector<int>& targets,
+    AlgorithmJob::Control* control
+) {
+    const int n = graph.n;
+    const auto is_valid = [n](int node) { return node >= 0 && node < n; };
+    if(!all_of(sources.begin(), sources.end(), is_valid) ||
+        !all_of(targets.begin(), targets.end(), is_valid)
+    ) { return false; }
+
+    vector<int> target_counts(n, 0);
+    int distinct_targets = 0;
+    for(int node : targets)
+        if(target_counts[node]++ == 0) distinct_targets++;
+
+    rows = sources.size();
+    columns = targets.size();
+    values.assign((size_t) rows * columns, UNREACHABLE);
+    if(rows == 0 || columns == 0) return true;
+    // Built before the threads read it
+    graph.neighbors(0);
+
+    get_pool().parallel_for(rows, 1, [&](int first, int last) {
+        Workspace& ws = workspace;
+        for(int row = first; row < last; row++) {
+            if(control != nullptr && control->is_cancelled()) return;
+            search(graph, sources[row], target_counts, distinct_targets, ws);
+
+            T* out = values.data() + (size_t) row * columns;
+            for(int column = 0; column < columns; column++) {
+                const int node = targets[column];
+                if(ws.is_reached(node)) out[column] = ws.distances[node];
+            }
+            if(control != nullptr) control->add_progress();
+        }
+    });
+    return control == nullptr || !control->is_cancelled();
+}
+
+int DistanceMatrix::get_rows() const { return rows; }
+int DistanceMatrix::get_columns() const { return columns; }
+Graph::T DistanceMatrix::get(int row, int column) const { return values[(size_t) row * columns + column]; }
+const vector<Graph::T>& DistanceMatrix::get_values() const { return values; }
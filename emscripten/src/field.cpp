@@ -3,25 +3,79 @@
 #include "misc/cpp/imgui_stdlib.h"
 
 #include "field.h"
+#include "step_trace.h"
 #include "utils.h"
 #include "main.h"
+#include "force_kernel.h"
 
 #include <math.h>
 #include <iostream>
+#include <climits>
+#include <chrono>
 
 using namespace std;
 
+namespace {
+    double clock_time() {
+        using namespace std::chrono;
+        return duration<double>(steady_clock::now().time_since_epoch()).count();
+    }
+}
+
 const Vec2 Field::DEF_GRAPH_LOC = {200, 200};
 const float Field::DEF_GRAPH_R = 100;
+const float Field::BARNES_HUT_THETA = 0.8;
+const float Field::MIN_SCALE = 0.05;
+const float Field::MAX_SCALE = 4;
+const float Field::EDGE_LABELS_MIN_SCALE = 0.6;
+const float Field::MIN_ROUND_NODE_R = 2;
 
 
 Field::FGraph::Selection::Selection(bool is_selected, ImColor color):
     is_selected(is_selected), color(color) {}
 
 Field::FGraph::FGraph(const Graph& graph): 
-    Graph(graph), points(connections.size()), speeds(connections.size()),
-    points_sel(connections.size()), edges_sel(edges.size()), edges_anno(edges.size()) {}
+    Graph(graph), points(n), speeds(n),
+    points_sel(n), edges_sel(edges.size()), edges_anno(edges.size()) {}
 Field::FGraphLink::FGraphLink(int graph_id, int index): graph_id(graph_id), index(index) {}
+Field::CellIndex::CellIndex(): cells(), slots(16, -1) {}
+Field::Grid::Grid(): index(), offsets(1), links(), xs(), ys(), point_cells() {}
+Field::Snapshot::Snapshot(): points(), time(0) {}
+Field::EnergyMap::EnergyMap(): index(), energy() {}
+
+void Field::CellIndex::clear(int count) {
+    // Keeping the load factor under 1/2
+    size_t capacity = 16;
+    while(capacity < 2 * (size_t) count) capacity *= 2;
+    if(slots.size() < capacity) slots.resize(capacity);
+    fill(slots.begin(), slots.end(), -1);
+    cells.clear();
+}
+
+int Field::CellIndex::get_home(pair<int, int> cell) const {
+    const unsigned long long key =
+        (static_cast<unsigned long long>(static_cast<unsigned int>(cell.first)) << 32) |
+        static_cast<unsigned int>(cell.second);
+    // Fibonacci hashing, the capacity is always a power of two
+    return static_cast<int>((key * 0x9E3779B97F4A7C15ull) >> 32) & (slots.size() - 1);
+}
+
+int Field::CellIndex::find(pair<int, int> cell) const {
+    const int mask = slots.size() - 1;
+    for(int slot = get_home(cell); slots[slot] != -1; slot = (slot + 1) & mask)
+        if(cells[slots[slot]] == cell) return slots[slot];
+    return -1;
+}
+
+int Field::CellIndex::insert(pair<int, int> cell) {
+    const int mask = slots.size() - 1;
+    int slot = get_home(cell);
+    for(; slots[slot] != -1; slot = (slot + 1) & mask)
+        if(cells[slots[slot]] == cell) return slots[slot];
+    slots[slot] = cells.size();
+    cells.push_back(cell);
+    return slots[slot];
+}
 
 void Field::FGraph::add_edge(int from, int to, int weight){
     if(from > to) swap(from, to);
@@ -32,8 +86,17 @@ void Field::FGraph::add_edge(int from, int to, int weight){
 
 void Field::FGraph::remove_edge(int edge_id){
     Graph::remove_edge(edge_id);
-    edges_sel.erase(edges_sel.begin() + edge_id);
-    edges_anno.erase(edges_anno.begin() + edge_id);
+    // Moved the same way as the edges
+    edges_sel[edge_id] = edges_sel.back();
+    edges_sel.pop_back();
+    edges_anno[edge_id] = move(edges_anno.back());
+    edges_anno.pop_back();
+}
+
+void Field::FGraph::replace_edges(const vector<Edge>& new_edges){
+    Graph::replace_edges(new_edges);
+    edges_sel.assign(edges.size(), Selection());
+    edges_anno.assign(edges.size(), "");
 }
 
 void Field::FGraph::clear_annotations() {
@@ -44,7 +107,14 @@ void Field::FGraph::clear_annotations() {
 
 Field::Field(float cell_size, Vec2 bounds): 
     cell_size(cell_size), bounds(bounds), graphs(),
-    is_dark_theme_selected(global::isDarkTheme) {}
+    is_dark_theme_selected(global::isDarkTheme),
+    latest_snapshot(0), back_snapshot(1), front_snapshot(2),
+    step_dt(0), step_period(0), next_step_time(0), simulation_running(false),
+    dragged(-1, 0), wake_requested(true), wake_all_points(true), converged(false) {
+    tick_options = pending_options = {use_ticks, bound_forces, use_barnes_hut, bounds};
+}
+
+Field::~Field() { stop_simulation(); }
 
 pair<int, int> Field::get_field_index(const Vec2& point) const {
     return {
@@ -53,33 +123,79 @@ pair<int, int> Field::get_field_index(const Vec2& point) const {
     };
 }
 
-void Field::remove_from_field(const pair<int, int>& field_index, FGraphLink point_index) {
-    field[field_index.first][field_index.second].remove(point_index);
+void Field::update_field() {
+    if(!field_dirty) return;
+    field_dirty = false;
+
+    int count = 0;
+    for(const auto& graph : graphs) count += graph.n;
+    field.index.clear(count);
+    field.offsets.assign(1, 0);
+    field.point_cells.resize(count);
+
+    int k = 0;
+    for(const auto& graph : graphs)
+    for(int i = 0; i < graph.n; i++, k++) {
+        const auto field_index = get_field_index(graph.points[i]);
+        int cell = -1;
+        if(is_in_field(field_index)) {
+            cell = field.index.insert(field_index);
+            if(cell == field.offsets.size() - 1) field.offsets.push_back(0);
+            field.offsets[cell + 1]++;
+        }
+        field.point_cells[k] = cell;
+    }
+    const int cells = field.index.cells.size();
+    for(int c = 0; c < cells; c++)
+        field.offsets[c + 1] += field.offsets[c];
+
+    // offsets[c] is moved along as the cell is filled, then shifted back
+    const int indexed = field.offsets.back();
+    field.links.resize(indexed, {-1, 0});
+    field.xs.resize(indexed);
+    field.ys.resize(indexed);
+    k = 0;
+    for(int g = 0; g < graphs.size(); g++)
+    for(int i = 0; i < graphs[g].n; i++, k++) {
+        const int cell = field.point_cells[k];
+        if(cell == -1) continue;
+        const Vec2& point = graphs[g].points[i];
+        const int position = field.offsets[cell]++;
+        field.xs[position] = point.x;
+        field.ys[position] = point.y;
+        field.links[position] = {g, i};
+    }
+    for(int c = cells; c > 0; c--) field.offsets[c] = field.offsets[c - 1];
+    field.offsets[0] = 0;
+}
+
+pair<const Field::FGraphLink*, const Field::FGraphLink*> Field::get_cell(int x, int y) const {
+    const int cell = field.index.find({x, y});
+    if(cell == -1) return {nullptr, nullptr};
+    const FGraphLink* links = field.links.data();
+    return {links + field.offsets[cell], links + field.offsets[cell + 1]};
 }
 
-void Field::add_to_field(const pair<int, int>& field_index, FGraphLink point_index) {
-    field[field_index.first][field_index.second].push_back(point_index);
+bool Field::is_in_field(pair<int, int> field_index) const {
+    return abs(field_index.first) <= MAX_GRID_RADIUS && abs(field_index.second) <= MAX_GRID_RADIUS;
 }
 
 int Field::add_graph(const Graph& graph, Vec2 point, float R) {
+    lock_guard<mutex> lock(physics_mutex);
     graphs.push_back(FGraph(graph));
     const int graph_id = graphs.size() - 1;
-    reset_points_pos(graph_id, point, R);
-
-    auto& fgraph = graphs[graph_id];
-    for(int i = 0; i < fgraph.connections.size(); i++){
-        const auto field_index = get_field_index(fgraph.points[i]);
-        add_to_field(field_index, { graph_id, i });
-    }
+    graphs[graph_id].get_adjacency();
+    place_points(graph_id, point, R);
+    reset_shown_points();
+    wake_simulation();
     return graph_id;
 }
 void Field::remove_graph(int index) {
-    auto& fgraph = graphs[index];
-    for(int i = 0; i < fgraph.connections.size(); i++){
-        const auto field_index = get_field_index(fgraph.points[i]);
-        remove_from_field(field_index, { index, i });
-    }
+    lock_guard<mutex> lock(physics_mutex);
     graphs.erase(graphs.begin() + index);
+    field_dirty = true;
+    reset_shown_points();
+    wake_simulation();
 }
 
 inline bool operator==(const Field::FGraphLink& a, const Field::FGraphLink& b)
@@ -97,6 +213,10 @@ Vec2 Field::def_compute_force(Vec2 delta, float force_distance, ForceType type)
         const float x = (delta.abs() - force_distance / 2);
         return delta.norm() * pow(x, 2) * sign(x);
     }
+    else if(type == FarNode){
+        const float k = force_distance / 2;
+        return -delta.norm() * (k * k / delta.abs());
+    }
     else {
         float x = 0;
         if(type == UpBound) x += delta.y;
@@ -112,56 +232,154 @@ Vec2 Field::def_compute_force(Vec2 delta, float force_distance, ForceType type)
 }
 
 void Field::do_tick(float dt, Vec2 (*force_function)(Vec2, float, ForceType)){
-    if(!use_ticks) return;
+    if(!tick_options.use_ticks) {
+        // Nothing moves, until the physics are back
+        converged = true;
+        return;
+    }
+    update_field();
+
+    const bool use_barnes_hut = tick_options.use_barnes_hut;
+    const bool bound_forces = tick_options.bound_forces;
+    const Vec2 bounds = tick_options.bounds;
+
+    // With Barnes-Hut the cells give the short-range Node repulsion (closer
+    // than cell_size) and the tree the FarNode one from all the other points.
+    if(use_barnes_hut) {
+        vector<Vec2> all_points;
+        for(const auto& graph : graphs)
+            all_points.insert(all_points.end(), graph.points.begin(), graph.points.end());
+        quad_tree.build(all_points);
+    }
+
+    // The default forces are computed by the SIMD kernel,
+    // the custom ones go through the function pointer.
+    const bool batched = force_function == &def_compute_force;
+    const float far_distance = use_barnes_hut ? cell_size : INFINITY;
 
-    vector<vector<Vec2>> forces(graphs.size());
+    // The Barnes-Hut forces change with any move, so there only
+    // the whole simulation could sleep
+    const bool wake_all = wake_all_points || use_barnes_hut;
+    wake_all_points = false;
+    if(moved.size() != graphs.size()) moved.resize(graphs.size());
+    active.resize(graphs.size());
+
+    forces.resize(graphs.size());
     for(int g = 0; g < graphs.size(); g++){
-        const int n = graphs[g].connections.size();
-        forces[g] = vector<Vec2>(n);
-        for(FGraphLink i = {0, g}; i.index < n; i.index++){
+        const int n = graphs[g].n;
+        forces[g].assign(n, Vec2());
+        active[g].assign(n, true);
+        if(moved[g].size() != n) moved[g].assign(n, true);
+        // The lazy adjacency must be built before the workers read it
+        const Graph::Adjacency& adjacency = graphs[g].get_adjacency();
+
+        pool.parallel_for(n, TICK_CHUNK, [&](int first, int last) {
+        for(FGraphLink i = {g, first}; i.index < last; i.index++){
             Vec2 &point = graphs[g].points[i.index];
+            const auto field_index = get_field_index(point);
+            Vec2 force;
+
+            // The sleeping point would get the same force, as on the last
+            // tick, which has already left it still
+            if(!wake_all && !is_region_active(field_index)) {
+                bool is_pulled = false;
+                for(const auto arc : graphs[g].neighbors(i.index))
+                    if(moved[g][arc.to]) {
+                        is_pulled = true;
+                        break;
+                    }
+                if(!is_pulled) {
+                    active[g][i.index] = false;
+                    continue;
+                }
+            }
 
-            // Looking over connected verticies
-            for(int j = 0; j < n; j++){
-                if(i.index == j || !graphs[g].connections[i.index][j]) continue;
-                Vec2 &point_b = graphs[g].points[j];
-                forces[i.graph_id][i.index] += force_function(
-                    point_b - point, cell_size, ConnectedNode);
+            if(batched) {
+                const int row = adjacency.offsets[i.index];
+                force += force_kernel::spring_attraction(
+                    point.x, point.y, graphs[g].points.data(), adjacency.neighbors.data() + row,
+                    adjacency.offsets[i.index + 1] - row, cell_size);
+
+                // The whole cells are taken, and then the connected
+                // points, found there, are taken back out.
+                for (int dx = -1; dx <= 1; dx++)
+                for (int dy = -1; dy <= 1; dy++) {
+                    const auto cell = get_cell(field_index.first + dx, field_index.second + dy);
+                    if(cell.first == cell.second) continue;
+                    const int from = cell.first - field.links.data();
+                    force += force_kernel::node_repulsion(
+                        point.x, point.y, field.xs.data() + from, field.ys.data() + from,
+                        cell.second - cell.first, cell_size, far_distance);
+                }
+                for(const auto arc : graphs[g].neighbors(i.index)){
+                    const Vec2 &point_b = graphs[g].points[arc.to];
+                    const auto index_b = get_field_index(point_b);
+                    if(abs(index_b.first - field_index.first) > 1 ||
+                        abs(index_b.second - field_index.second) > 1 ||
+                        !is_in_field(index_b)) continue;
+                    force += -force_kernel::node_repulsion(
+                        point.x, point.y, &point_b.x, &point_b.y, 1, cell_size, far_distance);
+                }
             }
+            else {
+                // Looking over connected verticies
+                for(const auto arc : graphs[g].neighbors(i.index)){
+                    if(i.index == arc.to) continue;
+                    Vec2 &point_b = graphs[g].points[arc.to];
+                    force += force_function(
+                        point_b - point, cell_size, ConnectedNode);
+                }
 
-            // Looking in the adjacent squares.
-            const auto field_index = get_field_index(point);
-            for (int dx = -1; dx <= 1; dx++)
-            for (int dy = -1; dy <= 1; dy++) {
-                const auto& list = field[field_index.first + dx][field_index.second + dy];
-                if(list.size() == 0) continue;
-                for(auto buff : list) {
-                    if (buff == i || graphs[g].connections[i.index][buff.index]) continue;
-                    const Vec2 &point_b = graphs[buff.graph_id].points[buff.index];
-                    forces[i.graph_id][i.index] += force_function(
-                        point_b - point, cell_size, Node);
+                // Looking in the adjacent squares.
+                for (int dx = -1; dx <= 1; dx++)
+                for (int dy = -1; dy <= 1; dy++) {
+                    const auto cell = get_cell(field_index.first + dx, field_index.second + dy);
+                    for(auto it = cell.first; it != cell.second; it++) {
+                        const FGraphLink buff = *it;
+                        if (buff == i || (buff.graph_id == g &&
+                            graphs[g].is_connected(i.index, buff.index))) continue;
+                        const Vec2 &point_b = graphs[buff.graph_id].points[buff.index];
+                        if (use_barnes_hut && (point_b - point).abs() >= cell_size) continue;
+                        force += force_function(
+                            point_b - point, cell_size, Node);
+                    }
+                }
+            }
+
+            if(use_barnes_hut) {
+                // The points closer than cell_size have got the Node force
+                // above, so the tree leaves them out. The connected points
+                // further away are taken back out, as they get no repulsion.
+                const auto far_force = [&](Vec2 delta) { return force_function(delta, cell_size, FarNode); };
+                force += quad_tree.accumulate(point, BARNES_HUT_THETA, cell_size, far_force);
+                for(const auto arc : graphs[g].neighbors(i.index)) {
+                    const Vec2 delta = graphs[g].points[arc.to] - point;
+                    if(arc.to != i.index && delta.abs() >= cell_size) force += -far_force(delta);
                 }
             }
 
             // Looking over walls
             if(bound_forces){
-                forces[i.graph_id][i.index] +=
+                force +=
                     force_function({point.x, 0}, cell_size, LeftBound) + 
                     force_function({point.x - bounds.x, 0}, cell_size, RightBound) + 
                     force_function({0, point.y}, cell_size, UpBound) +
                     force_function({0, point.y - bounds.y}, cell_size, DownBound);
             }
+            forces[g][i.index] = force;
         }
+        });
     }
 
     for(int g = 0; g < graphs.size(); g++){
-        const int n = graphs[g].connections.size();
-        for(FGraphLink i = {0, g}; i.index < n; i.index++){
-            Vec2 &point = graphs[g].points[i.index];
-            Vec2 &speed = graphs[g].speeds[i.index];
-            const auto field_index = get_field_index(point);
-            
-            speed += forces[i.graph_id][i.index] * dt;
+        pool.parallel_for(graphs[g].n, TICK_CHUNK, [&](int first, int last) {
+        for(int i = first; i < last; i++){
+            moved[g][i] = false;
+            if(!active[g][i]) continue;
+            Vec2 &point = graphs[g].points[i];
+            Vec2 &speed = graphs[g].speeds[i];
+
+            speed += forces[g][i] * dt;
             speed *= 0.95;
             const static float max_speed = 1e3;
             const float abs_speed = speed.abs();
@@ -169,39 +387,201 @@ void Field::do_tick(float dt, Vec2 (*force_function)(Vec2, float, ForceType)){
             if (abs_speed < 0.5) speed = {0, 0};
 
             point += speed * dt;
+            moved[g][i] = speed.x != 0 || speed.y != 0;
+        }
+        });
+    }
+    field_dirty = true;
+    update_energy(dt);
+}
+
+bool Field::is_region_active(pair<int, int> field_index) const {
+    for(int dy = -1; dy <= 1; dy++)
+    for(int dx = -1; dx <= 1; dx++) {
+        const int region = region_energy.index.find({field_index.first + dx, field_index.second + dy});
+        if(region != -1 && region_energy.energy[region] > 0) return true;
+    }
+    return false;
+}
+
+void Field::update_energy(float dt) {
+    // The regions are the grid cells, only the heated ones are kept
+    int count = 0;
+    for(int g = 0; g < graphs.size(); g++) count += graphs[g].n;
+    region_energy.index.clear(2 * count);
+    region_energy.energy.clear();
+    const auto add_energy = [&](const Vec2& point, float energy) {
+        const int region = region_energy.index.insert(get_field_index(point));
+        if(region == region_energy.energy.size()) region_energy.energy.push_back(0);
+        region_energy.energy[region] += energy;
+    };
+
+    // A moved point heats both the region it has left and the one it is in
+    float total = 0;
+    graph_energy.assign(graphs.size(), 0);
+    for(int g = 0; g < graphs.size(); g++)
+    for(int i = 0; i < graphs[g].n; i++) {
+        if(!moved[g][i]) continue;
+        const Vec2& point = graphs[g].points[i];
+        const Vec2& speed = graphs[g].speeds[i];
+        const float energy = (speed.x * speed.x + speed.y * speed.y) / 2;
+        add_energy(point, energy);
+        add_energy(point - speed * dt, energy);
+        graph_energy[g] += energy;
+        total += energy;
+    }
+    converged = total == 0;
+}
 
-            recalculate_cell_for_point(field_index, i);
+void Field::start_simulation(float dt, double period) {
+    stop_simulation();
+    step_dt = dt;
+    step_period = period;
+    next_step_time = clock_time();
+    #ifndef NO_THREADS
+    simulation_running = true;
+    simulation = thread([this] {
+        while(simulation_running) {
+            simulation_step();
+            if(converged) {
+                unique_lock<mutex> input_lock(input_mutex);
+                simulation_wake.wait(input_lock, [&] {
+                    return wake_requested || !simulation_running; });
+                next_step_time = clock_time();
+                continue;
+            }
+            // The missed steps are dropped, so a slow simulation just runs slower
+            const double now = clock_time();
+            next_step_time = max(next_step_time + step_period, now);
+            this_thread::sleep_for(chrono::duration<double>(next_step_time - now));
         }
+    });
+    #endif
+}
+
+void Field::stop_simulation() {
+    {
+        lock_guard<mutex> input_lock(input_mutex);
+        simulation_running = false;
+    }
+    simulation_wake.notify_all();
+    if(simulation.joinable()) simulation.join();
+}
+
+void Field::wake_simulation() {
+    {
+        lock_guard<mutex> input_lock(input_mutex);
+        wake_requested = true;
     }
+    simulation_wake.notify_all();
 }
 
-void Field::recalculate_cell_for_point(const pair<int, int>& old_field_index, FGraphLink point_index) {
-    const auto new_field_index = get_field_index(graphs[point_index.graph_id].points[point_index.index]);
-    if(old_field_index != new_field_index){
-        remove_from_field(old_field_index, point_index);
-        add_to_field(new_field_index, point_index);
+bool Field::is_converged() const { return converged; }
+
+void Field::update_simulation() {
+    #ifdef NO_THREADS
+    if(converged && !wake_requested)
+        next_step_time = clock_time();
+    else if(step_period > 0) {
+        const double now = clock_time();
+        for(int i = 0; i < MAX_CATCH_UP_STEPS && next_step_time <= now; i++) {
+            simulation_step();
+            next_step_time += step_period;
+        }
+        if(next_step_time <= now) next_step_time = now + step_period;
     }
+    #endif
+    update_shown_points();
+}
+
+unique_lock<mutex> Field::lock_physics() {
+    unique_lock<mutex> lock(physics_mutex);
+    wake_simulation();
+    return lock;
+}
+
+void Field::simulation_step() {
+    lock_guard<mutex> lock(physics_mutex);
+    {
+        lock_guard<mutex> input_lock(input_mutex);
+        tick_options = pending_options;
+        if(wake_requested) {
+            wake_requested = false;
+            wake_all_points = true;
+            converged = false;
+        }
+        if(dragged.graph_id != -1 && dragged.graph_id < graphs.size() &&
+            dragged.index < graphs[dragged.graph_id].n
+        ) {
+            graphs[dragged.graph_id].points[dragged.index] = dragged_point;
+            field_dirty = true;
+        }
+    }
+    do_tick(step_dt);
+    publish_snapshot();
+}
+
+void Field::publish_snapshot() {
+    Snapshot& snapshot = snapshots[back_snapshot];
+    snapshot.points.resize(graphs.size());
+    for(int g = 0; g < graphs.size(); g++)
+        snapshot.points[g].assign(graphs[g].points.begin(), graphs[g].points.end());
+    snapshot.time = clock_time();
+    back_snapshot = latest_snapshot.exchange(back_snapshot | NEW_SNAPSHOT) & ~NEW_SNAPSHOT;
+}
+
+void Field::update_shown_points() {
+    if(latest_snapshot.load() & NEW_SNAPSHOT) {
+        front_snapshot = latest_snapshot.exchange(front_snapshot) & ~NEW_SNAPSHOT;
+        swap(shown_prev, shown_cur);
+        shown_cur.points.resize(snapshots[front_snapshot].points.size());
+        for(int g = 0; g < shown_cur.points.size(); g++)
+            shown_cur.points[g] = snapshots[front_snapshot].points[g];
+        shown_cur.time = snapshots[front_snapshot].time;
+    }
+
+    // Showing the state one step back, so it could be interpolated
+    float alpha = 1;
+    if(step_period > 0)
+        alpha = min(max((clock_time() - shown_cur.time) / step_period, 0.0), 1.0);
+    shown_points.resize(shown_cur.points.size());
+    for(int g = 0; g < shown_cur.points.size(); g++) {
+        const auto& cur = shown_cur.points[g];
+        shown_points[g].resize(cur.size());
+        if(g >= shown_prev.points.size() || shown_prev.points[g].size() != cur.size()) {
+            shown_points[g] = cur;
+            continue;
+        }
+        const auto& prev = shown_prev.points[g];
+        for(int i = 0; i < cur.size(); i++)
+            shown_points[g][i] = prev[i] + (cur[i] - prev[i]) * alpha;
+    }
+}
+
+void Field::reset_shown_points() {
+    // Called under physics_mutex, when the points were changed from the UI
+    publish_snapshot();
+    update_shown_points();
+    shown_prev = shown_cur;
+    shown_points = shown_cur.points;
 }
 
 void Field::reset_points_pos(int graph_id, Vec2 point, float R) {
+    lock_guard<mutex> lock(physics_mutex);
+    place_points(graph_id, point, R);
+    reset_shown_points();
+    wake_simulation();
+}
+
+void Field::place_points(int graph_id, Vec2 point, float R) {
     FGraph& graph = graphs[graph_id];
-    const int n = graph.connections.size();
+    const int n = graph.n;
     for(int i = 0; i < n; i++) {
-        // Removing the old one from the field
-        {
-            const auto field_index = get_field_index(graph.points[i]);
-            remove_from_field(field_index, { graph_id, i });
-        }
-
-        // Setting new position
         const float alpha = 2 * i * PI / n;
         graph.points[i] = Vec2{ cos(alpha), sin(alpha) } * R + point;
         graph.speeds[i] = {0, 0};
-        {
-            const auto field_index = get_field_index(graph.points[i]);
-            add_to_field(field_index, { graph_id, i });
-        }
     }
+    field_dirty = true;
 }
 
 void Field::display_window(){
@@ -256,32 +636,51 @@ void Field::display_window(){
         middle_mouse_delta = {0, 0};
         was_middle_mouse = false;
     }
+
+    // Zooming around the mouse
+    const float wheel = ImGui::GetIO().MouseWheel;
+    if(wheel != 0 && ImGui::IsItemHovered()) {
+        const Vec2 p = const_p + middle_mouse_shift + middle_mouse_delta;
+        const Vec2 mouse_point = (mouse - p) / scale;
+        scale = min(max(scale * pow(1.1f, wheel), MIN_SCALE), MAX_SCALE);
+        middle_mouse_shift += mouse - mouse_point * scale - p;
+    }
     const auto p = const_p + middle_mouse_shift + middle_mouse_delta;
+    // The mouse in the field coordinates
+    const Vec2 mouse_point = (mouse - p) / scale;
 
     if (selected.graph_id == -1 && ImGui::IsItemClicked(ImGuiMouseButton_Left))
     {
-        auto field_index = get_field_index(mouse - p);
-        int shift_x = 2 * fmod(mouse.x - p.x, cell_size) >= cell_size;
-        int shift_y = 2 * fmod(mouse.y - p.y, cell_size) >= cell_size;
+        lock_guard<mutex> lock(physics_mutex);
+        update_field();
+        auto field_index = get_field_index(mouse_point);
+        int shift_x = 2 * fmod(mouse_point.x, cell_size) >= cell_size;
+        int shift_y = 2 * fmod(mouse_point.y, cell_size) >= cell_size;
         for(int dx = -1; dx <= 0 && selected.graph_id == -1; dx++)
         for(int dy = -1; dy <= 0 && selected.graph_id == -1; dy++){
-            const auto& list = field[field_index.first + dx + shift_x][field_index.second + dy + shift_y];
-            if(list.size() == 0) continue;
-            for(auto buff : list){
+            const auto cell = get_cell(field_index.first + dx + shift_x, field_index.second + dy + shift_y);
+            for(auto it = cell.first; it != cell.second; it++){
+                const FGraphLink buff = *it;
                 if(selected.graph_id != -1) break;
                 const Vec2 &point = graphs[buff.graph_id].points[buff.index];
-                if ((point + p - mouse).abs() <= R) selected = buff;
+                if ((point - mouse_point).abs() <= R) selected = buff;
             }
         }
     }
     if (selected.graph_id != -1 && ImGui::IsMouseDown(ImGuiMouseButton_Left)){
-        Vec2& point = graphs[selected.graph_id].points[selected.index];
-        const auto old_field_index = get_field_index(point);
-        point = mouse - p;
-        recalculate_cell_for_point(old_field_index, selected);
+        if(selected.graph_id < shown_points.size() && selected.index < shown_points[selected.graph_id].size())
+            shown_points[selected.graph_id][selected.index] = mouse_point;
+        lock_guard<mutex> input_lock(input_mutex);
+        dragged = selected;
+        dragged_point = mouse_point;
+        wake_requested = true;
+        simulation_wake.notify_all();
     }
-    else if (selected.graph_id != -1 && !ImGui::IsItemClicked(ImGuiMouseButton_Left))
+    else if (selected.graph_id != -1 && !ImGui::IsItemClicked(ImGuiMouseButton_Left)) {
         selected = {-1, 0};
+        lock_guard<mutex> input_lock(input_mutex);
+        dragged = selected;
+    }
 
     static bool debug_field = false;
     ImGui::SetCursorPos(cursor);
@@ -302,6 +701,15 @@ void Field::display_window(){
         }
         ImGui::SameLine();
         ImGui::Checkbox("Bounds", &bound_forces);
+        ImGui::SameLine();
+        ImGui::Checkbox("BH", &use_barnes_hut);
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(80);
+        ImGui::SliderFloat("Zoom", &scale, MIN_SCALE, MAX_SCALE, "%.2f");
+        ImGui::SameLine();
+        ImGui::BeginDisabled(!renderer.is_available());
+        ImGui::Checkbox("GPU", &use_gpu);
+        ImGui::EndDisabled();
 
         ImGui::SameLine();
         if(ImGui::Checkbox("Use dark theme", &is_dark_theme_selected)) {
@@ -354,135 +762,229 @@ void Field::display_window(){
     const ImU32 green_col = ImColor(0.0f, 1.0f, 0.1f, 1.0f);
     const ImU32 blue_col = ImColor(0.0f, 0.0f, 1.0f, 1.0f);
 
+    // Everything outside of the canvas is culled, the level of detail
+    // goes down with the size of the nodes on the screen
+    const Vec2 view_min = const_p, view_max = const_p + available_space;
+    const float r = R * scale;
+    const auto is_visible = [&](Vec2 a, Vec2 b, float margin) {
+        return max(a.x, b.x) + margin >= view_min.x && min(a.x, b.x) - margin <= view_max.x &&
+            max(a.y, b.y) + margin >= view_min.y && min(a.y, b.y) - margin <= view_max.y;
+    };
+    const int node_segments = min(max((int) r, 6), 36);
+    const bool show_edge_labels = show_edge_weights && scale >= EDGE_LABELS_MIN_SCALE;
+    const float text_height = ImGui::GetTextLineHeight();
+
+    // The node labels are dropped, when they would not fit into the
+    // nodes, or when there are too many of them on the screen
+    int visible_nodes = 0;
+    for(int g = 0; g < graphs.size() && g < shown_points.size(); g++)
+    for(const auto& point : shown_points[g])
+        if(is_visible(p + point * scale, p + point * scale, r)) visible_nodes++;
+    const bool show_node_labels = show_node_ids &&
+        2 * r >= text_height && visible_nodes <= MAX_LABELED_NODES;
+
     ImDrawList *draw_list = ImGui::GetWindowDrawList();
-    for(int g = 0; g < graphs.size(); g++){
+    // On the GPU path the nodes and the edges are instanced in the field
+    // coordinates (the clipping culls them), and only the labels and the
+    // selection marks go through the draw list, on top of them
+    const bool gpu = use_gpu && renderer.is_available();
+    if(gpu) {
+        node_instances.clear();
+        edge_instances.clear();
+        for(int g = 0; g < graphs.size() && g < shown_points.size(); g++){
+            const auto& graph = graphs[g];
+            const auto& points = shown_points[g];
+            for(int i = 0; i < graph.edges.size(); i++){
+                const bool is_selected = graph.edges_sel[i].is_selected;
+                if(!is_selected && show_only_selected_edges) continue;
+                edge_instances.push_back({
+                    points[graph.edges[i].first], points[graph.edges[i].second],
+                    is_selected ? (ImU32) graph.edges_sel[i].color : edge_color,
+                    is_selected ? 3.0f : 1.0f
+                });
+            }
+            for(int i = 0; i < graph.n; i++)
+                node_instances.push_back({points[i], r, node_color});
+        }
+        renderer.set_edges(edge_instances);
+        renderer.set_nodes(node_instances);
+        renderer.set_transform(p, {scale, scale});
+        renderer.draw(draw_list);
+    }
+
+    for(int g = 0; g < graphs.size() && g < shown_points.size(); g++){
         const auto& graph = graphs[g];
+        const auto& points = shown_points[g];
 
         // Drawing edges
         const int m = graph.edges.size();
         for (int i = 0; i < m; i++){
-            auto a = p + graph.points[graph.edges[i].first];
-            auto b = p + graph.points[graph.edges[i].second];
-            if(graph.edges_sel[i].is_selected){
-                draw_list->AddLine(a, b,
-                    graph.edges_sel[i].color, 3.0f
-                );
+            const bool is_selected = graph.edges_sel[i].is_selected;
+            if(!is_selected && show_only_selected_edges) continue;
+            auto a = p + points[graph.edges[i].first] * scale;
+            auto b = p + points[graph.edges[i].second] * scale;
+            if(!is_visible(a, b, 0)) continue;
+
+            if(!gpu) {
+                if(is_selected){
+                    draw_list->AddLine(a, b,
+                        graph.edges_sel[i].color, 3.0f
+                    );
+                }
+                else
+                    draw_list->AddLine(a, b, edge_color);
             }
-            else if(!show_only_selected_edges)
-                draw_list->AddLine(a, b, edge_color);
-
-            if(show_edge_weights && (graph.edges_sel[i].is_selected || !show_only_selected_edges)) {
-                string num;
-                if(!show_actual_distance) num = to_string(graph.edges[i].weight);
-                else num = to_string((int) round(get_field_distance(
-                    g, graph.edges[i].first, graph.edges[i].second)));
+
+            const Vec2 middle = (a + b) / 2;
+            if(show_edge_labels && is_visible(middle, middle, 0) && (b - a).abs() >= 2 * r) {
+                const auto& num = !show_actual_distance ?
+                    labels.get(g, LabelCache::EdgeWeight, i, graph.edges[i].weight) :
+                    labels.get(g, LabelCache::EdgeDistance, i, (int) round(
+                        (points[graph.edges[i].first] - points[graph.edges[i].second]).abs()));
                 
-                const auto calc_size = ImGui::CalcTextSize(num.c_str());
-                const auto text_p1 = (a + b) / 2 - (Vec2) calc_size / 2;
-                draw_list->AddRectFilled(text_p1, text_p1 + calc_size, text_bg_color);
+                const auto text_p1 = middle - num.size / 2;
+                draw_list->AddRectFilled(text_p1, text_p1 + num.size, text_bg_color);
                 draw_list->AddText(text_p1,
-                    text_color, num.c_str()
+                    text_color, num.text.c_str()
                 );
 
                 if(!graph.edges_anno[i].empty()) { 
-                    const auto anno_size = ImGui::CalcTextSize(graph.edges_anno[i].c_str());
-                    const auto anno_p1 = (a + b) / 2  - (Vec2) anno_size / 2 + Vec2{0, calc_size.y};
-                    draw_list->AddRectFilled(anno_p1, anno_p1 + anno_size, text_bg_color);
+                    const auto& anno = labels.get(g, LabelCache::EdgeAnnotation, i, graph.edges_anno[i]);
+                    const auto anno_p1 = middle - anno.size / 2 + Vec2{0, num.size.y};
+                    draw_list->AddRectFilled(anno_p1, anno_p1 + anno.size, text_bg_color);
                     draw_list->AddText(anno_p1,
-                        text_color, graph.edges_anno[i].c_str()
+                        text_color, anno.text.c_str()
                     );
                 }
             }
         }
 
         // Drawing nodes
-        const int n = graph.connections.size();
+        const int n = graph.n;
         for (int i = 0; i < n; i++)
         {
-            const Vec2& point = graph.points[i];
+            const Vec2 point = p + points[i] * scale;
+            if(!is_visible(point, point, r + 1)) continue;
+
             // TODO: implement random coloring
-            draw_list->AddNgonFilled(p + point, R, node_color, 36);
-            if(graph.points_sel[i].is_selected)
-                draw_list->AddCircle(p + point, R + 1, graph.points_sel[i].color, 36, 5.0f);
+            if(gpu) {
+                if(graph.points_sel[i].is_selected)
+                    draw_list->AddCircle(point, r + 1, graph.points_sel[i].color, node_segments, 5.0f);
+            }
+            else if(r < MIN_ROUND_NODE_R) {
+                draw_list->AddRectFilled(point - Vec2{r, r}, point + Vec2{r, r}, node_color);
+                if(graph.points_sel[i].is_selected)
+                    draw_list->AddRect(point - Vec2{r, r}, point + Vec2{r, r},
+                        graph.points_sel[i].color, 0, 0, 2.0f);
+            }
+            else {
+                draw_list->AddNgonFilled(point, r, node_color, node_segments);
+                if(graph.points_sel[i].is_selected)
+                    draw_list->AddCircle(point, r + 1, graph.points_sel[i].color, node_segments, 5.0f);
+            }
 
-            if(show_node_ids){
-                string num = to_string(i);
+            if(show_node_labels){
+                const auto& num = labels.get(g, LabelCache::NodeId, i, i);
                 draw_list->AddText(
-                    p + point - (Vec2) ImGui::CalcTextSize(num.c_str()) / 2,
-                    blue_col, num.c_str()
+                    point - num.size / 2,
+                    blue_col, num.text.c_str()
                 );
             }
         }
     }
 
-    if(debug_field)
-    for (auto i = field.begin(); i != field.end(); i++){
-        if(i->first < 0 || i->first * cell_size > available_space.x) continue;
-        for(auto j = i->second.begin(); j != i->second.end(); j++){
-            if(j->first < 0 || j->first * cell_size > available_space.y) continue;
-            ImGui::SetCursorPos(cursor + (p - const_p) + Vec2{i->first * cell_size, j->first * cell_size});
+    if(debug_field) {
+        lock_guard<mutex> lock(physics_mutex);
+        for (const auto [x, y] : field.index.cells){
+            if(x < 0 || y < 0 || x * cell_size * scale > available_space.x ||
+                y * cell_size * scale > available_space.y) continue;
+            const auto cell = get_cell(x, y);
+            ImGui::SetCursorPos(cursor + (p - const_p) + Vec2{x * cell_size, y * cell_size} * scale);
             {
-                string num = to_string(j->second.size());
+                string num = to_string(cell.second - cell.first);
                 ImGui::TextColored(ImVec4(0, 255, 0, 255), num.c_str());
             }
         }
     }
 
+    {
+        lock_guard<mutex> input_lock(input_mutex);
+        const TickOptions options = {use_ticks, bound_forces, use_barnes_hut, bounds};
+        if(options.use_ticks != pending_options.use_ticks ||
+            options.bound_forces != pending_options.bound_forces ||
+            options.use_barnes_hut != pending_options.use_barnes_hut ||
+            options.bounds.x != pending_options.bounds.x || options.bounds.y != pending_options.bounds.y
+        ) {
+            wake_requested = true;
+            simulation_wake.notify_all();
+        }
+        pending_options = options;
+    }
+
     ImGui::End();
 }
 
 
-void Field::select_point(int point_id, int graph_id, ImColor color) {
+void Field::set_point_selection(int point_id, int graph_id, const FGraph::Selection& value) {
     auto& selection = graphs[graph_id].points_sel[point_id];
-    if(selection.color != color) selection.color = color;
-    selection.is_selected = true;
+    if(trace != nullptr) trace->record(StepTrace::Point, graph_id, point_id, selection, value);
+    selection = value;
+}
+void Field::set_edge_selection(int edge_id, int graph_id, const FGraph::Selection& value) {
+    auto& selection = graphs[graph_id].edges_sel[edge_id];
+    if(trace != nullptr) trace->record(StepTrace::Edge, graph_id, edge_id, selection, value);
+    selection = value;
+}
+
+void Field::select_point(int point_id, int graph_id, ImColor color) {
+    set_point_selection(point_id, graph_id, FGraph::Selection(true, color));
 }
 void Field::disselect_point(int point_id, int graph_id) {
-    auto& selection = graphs[graph_id].points_sel[point_id];
-    selection.is_selected = false;
+    const auto& selection = graphs[graph_id].points_sel[point_id];
+    set_point_selection(point_id, graph_id, FGraph::Selection(false, selection.color));
 }
 void Field::disselect_all_points(int graph_id) {
-    for(int i = 0; i < graphs[graph_id].connections.size(); i++)
+    for(int i = 0; i < graphs[graph_id].n; i++)
         disselect_point(i, graph_id);
 }
 void Field::toggle_point_select(int point_id, int graph_id, ImColor color) {
-    auto& selection = graphs[graph_id].points_sel[point_id];
-    if(selection.is_selected) selection.is_selected = false;
-    else {
-        if(selection.color != color) selection.color = color;
-        selection.is_selected = true;
-    }
+    const auto& selection = graphs[graph_id].points_sel[point_id];
+    if(selection.is_selected) disselect_point(point_id, graph_id);
+    else select_point(point_id, graph_id, color);
 }
 
 void Field::select_edge(int edge_id, int graph_id, ImColor color) {
     if(edge_id == -1) return;
-    auto& selection = graphs[graph_id].edges_sel[edge_id];
-    if(selection.color != color) selection.color = color;
-    selection.is_selected = true;
+    set_edge_selection(edge_id, graph_id, FGraph::Selection(true, color));
 }
 void Field::disselect_edge(int edge_id, int graph_id) {
-    auto& selection = graphs[graph_id].edges_sel[edge_id];
-    selection.is_selected = false;
+    const auto& selection = graphs[graph_id].edges_sel[edge_id];
+    set_edge_selection(edge_id, graph_id, FGraph::Selection(false, selection.color));
 }
 void Field::disselect_all_edges(int graph_id) {
     for(int m = 0; m < graphs[graph_id].edges.size(); m++)
         disselect_edge(m, graph_id);
 }
 void Field::toggle_edge_select(int edge_id, int graph_id, ImColor color) {
-    auto& selection = graphs[graph_id].edges_sel[edge_id];
-    if(selection.is_selected) selection.is_selected = false;
-    else {
-        if(selection.color != color) selection.color = color;
-        selection.is_selected = true;
-    }
+    const auto& selection = graphs[graph_id].edges_sel[edge_id];
+    if(selection.is_selected) disselect_edge(edge_id, graph_id);
+    else select_edge(edge_id, graph_id, color);
 }
 
+void Field::set_trace(StepTrace* trace) { this->trace = trace; }
+
 const vector<Field::FGraph>& Field::get_graphs() const { return graphs; }
 Field::FGraph* Field::get_graph(int graph_index) { return &graphs[graph_index]; }
 
+float Field::get_kinetic_energy(int graph_id) const {
+    if(graph_id >= graph_energy.size()) return 0;
+    return graph_energy[graph_id];
+}
+
 float Field::get_field_distance(int graph_id, int from_id, int to_id)
 {
-    const auto& points = graphs[graph_id].points;
+    // The shown points, as the simulation may be moving the actual ones
+    const auto& points = shown_points[graph_id];
     return (points[from_id] - points[to_id]).abs();
 }
 
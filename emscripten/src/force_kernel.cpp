@@ -0,0 +1,168 @@
+#include "force_kernel.h"
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SSE_KERNEL
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#define WASM_KERNEL
+#endif
+
+using namespace std;
+
+namespace {
+    // The scalar forms, used for the tails and without SIMD
+    inline float node_magnitude(float d2, float force_distance, float far_distance) {
+        if(d2 <= 0) return 0;
+        const float d = sqrt(d2);
+        if(d >= far_distance) return 0;
+        const float x = d - force_distance;
+        const float t = x / 10;
+        return (x >= 0 ? sqrt(x) * 10 : t * t * t) / d;
+    }
+
+    inline float spring_magnitude(float d2, float force_distance) {
+        if(d2 <= 0) return 0;
+        const float d = sqrt(d2);
+        const float x = d - force_distance / 2;
+        return x * fabs(x) / d;
+    }
+
+    #if defined(SSE_KERNEL) || defined(WASM_KERNEL)
+    // 4 floats with just the operations the kernels need
+    struct F4 {
+        #ifdef SSE_KERNEL
+        __m128 v;
+        F4(__m128 v): v(v) {}
+        #else
+        v128_t v;
+        F4(v128_t v): v(v) {}
+        #endif
+        F4() {}
+
+        #ifdef SSE_KERNEL
+        static inline F4 set(float a) { return _mm_set1_ps(a); }
+        static inline F4 set(float a, float b, float c, float d) { return _mm_setr_ps(a, b, c, d); }
+        static inline F4 load(const float* p) { return _mm_loadu_ps(p); }
+
+        inline F4 operator+(F4 b) const { return _mm_add_ps(v, b.v); }
+        inline F4 operator-(F4 b) const { return _mm_sub_ps(v, b.v); }
+        inline F4 operator*(F4 b) const { return _mm_mul_ps(v, b.v); }
+        inline F4 operator/(F4 b) const { return _mm_div_ps(v, b.v); }
+        inline F4 operator>(F4 b) const { return _mm_cmpgt_ps(v, b.v); }
+        inline F4 operator<(F4 b) const { return _mm_cmplt_ps(v, b.v); }
+        inline F4 operator>=(F4 b) const { return _mm_cmpge_ps(v, b.v); }
+        inline F4 operator&(F4 b) const { return _mm_and_ps(v, b.v); }
+
+        static inline F4 sqrt(F4 a) { return _mm_sqrt_ps(a.v); }
+        static inline F4 max(F4 a, F4 b) { return _mm_max_ps(a.v, b.v); }
+        static inline F4 abs(F4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+        // mask ? a : b, lane by lane
+        static inline F4 select(F4 mask, F4 a, F4 b)
+        { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+        inline float sum() const {
+            float buff[4];
+            _mm_storeu_ps(buff, v);
+            return (buff[0] + buff[1]) + (buff[2] + buff[3]);
+        }
+        #else
+        static inline F4 set(float a) { return wasm_f32x4_splat(a); }
+        static inline F4 set(float a, float b, float c, float d) { return wasm_f32x4_make(a, b, c, d); }
+        static inline F4 load(const float* p) { return wasm_v128_load(p); }
+
+        inline F4 operator+(F4 b) const { return wasm_f32x4_add(v, b.v); }
+        inline F4 operator-(F4 b) const { return wasm_f32x4_sub(v, b.v); }
+        inline F4 operator*(F4 b) const { return wasm_f32x4_mul(v, b.v); }
+        inline F4 operator/(F4 b) const { return wasm_f32x4_div(v, b.v); }
+        inline F4 operator>(F4 b) const { return wasm_f32x4_gt(v, b.v); }
+        inline F4 operator<(F4 b) const { return wasm_f32x4_lt(v, b.v); }
+        inline F4 operator>=(F4 b) const { return wasm_f32x4_ge(v, b.v); }
+        inline F4 operator&(F4 b) const { return wasm_v128_and(v, b.v); }
+
+        static inline F4 sqrt(F4 a) { return wasm_f32x4_sqrt(a.v); }
+        static inline F4 max(F4 a, F4 b) { return wasm_f32x4_pmax(a.v, b.v); }
+        static inline F4 abs(F4 a) { return wasm_f32x4_abs(a.v); }
+        static inline F4 select(F4 mask, F4 a, F4 b) { return wasm_v128_bitselect(a.v, b.v, mask.v); }
+        inline float sum() const {
+            return (wasm_f32x4_extract_lane(v, 0) + wasm_f32x4_extract_lane(v, 1)) +
+                (wasm_f32x4_extract_lane(v, 2) + wasm_f32x4_extract_lane(v, 3));
+        }
+        #endif
+    };
+
+    inline F4 node_magnitude(F4 d2, F4 force_distance, F4 far_distance) {
+        const F4 zero = F4::set(0);
+        const F4 d = F4::sqrt(d2);
+        const F4 x = d - force_distance;
+        const F4 t = x * F4::set(0.1f);
+        const F4 near = F4::sqrt(F4::max(x, zero)) * F4::set(10);
+        const F4 magnitude = F4::select(x >= zero, near, t * t * t) / d;
+        // The coincident points give NaN here, so they are dropped by the mask
+        return F4::select((d2 > zero) & (d < far_distance), magnitude, zero);
+    }
+
+    inline F4 spring_magnitude(F4 d2, F4 force_distance) {
+        const F4 zero = F4::set(0);
+        const F4 d = F4::sqrt(d2);
+        const F4 x = d - force_distance * F4::set(0.5f);
+        return F4::select(d2 > zero, x * F4::abs(x) / d, zero);
+    }
+    #endif
+}
+
+Vec2 force_kernel::node_repulsion(
+    float x, float y, const float* xs, const float* ys, int count,
+    float force_distance, float far_distance
+) {
+    int i = 0;
+    Vec2 ret;
+    #if defined(SSE_KERNEL) || defined(WASM_KERNEL)
+    const F4 px = F4::set(x), py = F4::set(y);
+    const F4 fd = F4::set(force_distance), far = F4::set(far_distance);
+    F4 fx = F4::set(0), fy = F4::set(0);
+    for(; i + 4 <= count; i += 4) {
+        const F4 dx = F4::load(xs + i) - px;
+        const F4 dy = F4::load(ys + i) - py;
+        const F4 magnitude = node_magnitude(dx * dx + dy * dy, fd, far);
+        fx = fx + dx * magnitude;
+        fy = fy + dy * magnitude;
+    }
+    ret = {fx.sum(), fy.sum()};
+    #endif
+    for(; i < count; i++) {
+        const float dx = xs[i] - x, dy = ys[i] - y;
+        const float magnitude = node_magnitude(dx * dx + dy * dy, force_distance, far_distance);
+        ret += Vec2{dx, dy} * magnitude;
+    }
+    return ret;
+}
+
+Vec2 force_kernel::spring_attraction(
+    float x, float y, const Vec2* points, const int* targets, int count,
+    float force_distance
+) {
+    int i = 0;
+    Vec2 ret;
+    #if defined(SSE_KERNEL) || defined(WASM_KERNEL)
+    const F4 px = F4::set(x), py = F4::set(y);
+    const F4 fd = F4::set(force_distance);
+    F4 fx = F4::set(0), fy = F4::set(0);
+    for(; i + 4 <= count; i += 4) {
+        const Vec2 &a = points[targets[i]], &b = points[targets[i + 1]],
+            &c = points[targets[i + 2]], &d = points[targets[i + 3]];
+        const F4 dx = F4::set(a.x, b.x, c.x, d.x) - px;
+        const F4 dy = F4::set(a.y, b.y, c.y, d.y) - py;
+        const F4 magnitude = spring_magnitude(dx * dx + dy * dy, fd);
+        fx = fx + dx * magnitude;
+        fy = fy + dy * magnitude;
+    }
+    ret = {fx.sum(), fy.sum()};
+    #endif
+    for(; i < count; i++) {
+        const float dx = points[targets[i]].x - x, dy = points[targets[i]].y - y;
+        ret += Vec2{dx, dy} * spring_magnitude(dx * dx + dy * dy, force_distance);
+    }
+    return ret;
+}
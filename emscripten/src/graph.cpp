@@ -3,9 +3,110 @@
 #include "utils.h"
 
 #include <iostream>
+#include <algorithm>
 
 using namespace std;
 
+EdgeIndex::EdgeIndex(): keys(), ids(), count(0) {}
+
+long long EdgeIndex::get_key(int from, int to) {
+    if(from > to) swap(from, to);
+    return (static_cast<long long>(from) << 32) | static_cast<unsigned int>(to);
+}
+
+int EdgeIndex::get_home(long long key) const {
+    // Fibonacci hashing, the capacity is always a power of two
+    const unsigned long long hash = static_cast<unsigned long long>(key) * 0x9E3779B97F4A7C15ull;
+    return static_cast<int>(hash >> 32) & (keys.size() - 1);
+}
+
+void EdgeIndex::rehash(int capacity) {
+    vector<long long> old_keys(capacity, -1);
+    vector<int> old_ids(capacity, -1);
+    swap(keys, old_keys);
+    swap(ids, old_ids);
+    const int mask = capacity - 1;
+    for(int i = 0; i < old_keys.size(); i++) {
+        if(old_keys[i] == -1) continue;
+        int slot = get_home(old_keys[i]);
+        while(keys[slot] != -1) slot = (slot + 1) & mask;
+        keys[slot] = old_keys[i];
+        ids[slot] = old_ids[i];
+    }
+}
+
+int EdgeIndex::find(int from, int to) const {
+    if(count == 0) return -1;
+    const long long key = get_key(from, to);
+    const int mask = keys.size() - 1;
+    for(int slot = get_home(key); keys[slot] != -1; slot = (slot + 1) & mask)
+        if(keys[slot] == key) return ids[slot];
+    return -1;
+}
+
+void EdgeIndex::insert(int from, int to, int id) {
+    // Keeping the load factor under 1/2
+    if(2 * (count + 1) > keys.size())
+        rehash(max(16, 2 * (int) keys.size()));
+    const long long key = get_key(from, to);
+    const int mask = keys.size() - 1;
+    int slot = get_home(key);
+    while(keys[slot] != -1 && keys[slot] != key) slot = (slot + 1) & mask;
+    if(keys[slot] == -1) count++;
+    keys[slot] = key;
+    ids[slot] = id;
+}
+
+void EdgeIndex::erase(int from, int to) {
+    if(count == 0) return;
+    const long long key = get_key(from, to);
+    const int mask = keys.size() - 1;
+    int slot = get_home(key);
+    while(keys[slot] != key) {
+        if(keys[slot] == -1) return;
+        slot = (slot + 1) & mask;
+    }
+    count--;
+
+    // Backward shift deletion, so no tombstones are needed
+    for(int next = (slot + 1) & mask; keys[next] != -1; next = (next + 1) & mask) {
+        const int home = get_home(keys[next]);
+        const bool movable = slot <= next ?
+            (home <= slot || home > next) :
+            (home <= slot && home > next);
+        if(!movable) continue;
+        keys[slot] = keys[next];
+        ids[slot] = ids[next];
+        slot = next;
+    }
+    keys[slot] = -1;
+    ids[slot] = -1;
+}
+
+void EdgeIndex::clear() {
+    fill(keys.begin(), keys.end(), -1);
+    fill(ids.begin(), ids.end(), -1);
+    count = 0;
+}
+
+void EdgeIndex::reserve(int size) {
+    int capacity = 16;
+    while(capacity < 2 * size) capacity *= 2;
+    if(capacity > keys.size()) rehash(capacity);
+}
+
+
+namespace {
+    int find_arc_in(const Graph::Adjacency& adjacency, int from, int to) {
+        const auto first = adjacency.neighbors.begin() + adjacency.offsets[from];
+        const auto last = adjacency.neighbors.begin() + adjacency.offsets[from + 1];
+        const auto it = lower_bound(first, last, to);
+        if(it == last || *it != to) return -1;
+        return it - adjacency.neighbors.begin();
+    }
+}
+
+
 Graph::Connection::Connection(): weight(0), connected(false) {}
 Graph::Connection::Connection(bool connected): weight(connected), connected(connected) {}
 Graph::Connection::Connection(T weight): weight(weight), connected(true) {}
@@ -23,47 +124,146 @@ bool Graph::Edge::operator<(const Edge& b) const {
     return second < b.second;
 }
 
-Graph::Graph(): connections(0), edges(0) {}
-Graph::Graph(int n): connections(n, vector<Connection>(n)), edges(0) {}
-Graph::Graph(vector<vector<Connection>>&& connections): connections(move(connections)), edges(0) {
-    for(int i = 0; i < this->connections.size(); i++)
-    for(int j = i + 1; j < this->connections[i].size(); j++)
-        if(this->connections[i][j]) edges.push_back(
-            {i, j, this->connections[i][j].weight});
-}
-Graph::Graph(int n, vector<Edge>&& edges): connections(n, vector<Connection>(n)), edges(move(edges)) {
-    for(auto& edge : this->edges) {
-        connections[edge.first][edge.second] = edge.weight;
-        connections[edge.second][edge.first] = edge.weight;
-    }
+Graph::Graph(): n(0), edges(0), adjacency(), adjacency_dirty(true) {}
+Graph::Graph(int n): n(n), edges(0), adjacency(), adjacency_dirty(true) {}
+Graph::Graph(vector<vector<Connection>>&& connections):
+    n(connections.size()), edges(0), adjacency(), adjacency_dirty(true) {
+    for(int i = 0; i < n; i++)
+    for(int j = i + 1; j < connections[i].size(); j++)
+        if(connections[i][j]) edges.push_back(
+            {i, j, connections[i][j].weight});
 }
+Graph::Graph(int n, vector<Edge>&& edges):
+    n(n), edges(move(edges)), adjacency(), adjacency_dirty(true) {}
 
 void Graph::add_edge(int from, int to, int weight) {
     if(from > to) swap(from, to);
     edges.push_back(Edge(from, to, weight));
-    connections[from][to] = weight;
-    connections[to][from] = weight;
+    adjacency_dirty = true;
 }
 
 void Graph::remove_edge(int edge_id) {
-    int from = edges[edge_id].first;
-    int to = edges[edge_id].second;
-    connections[from][to].connected = false;
-    connections[to][from].connected = false;
-    edges.erase(edges.begin() + edge_id);
+    // Swap remove, only the last edge changes its id
+    const int last = edges.size() - 1;
+    if(edge_id != last) edges[edge_id] = edges[last];
+    edges.pop_back();
+    adjacency_dirty = true;
+}
+
+void Graph::replace_edges(const vector<Edge>& new_edges) {
+    edges = new_edges;
+    adjacency_dirty = true;
 }
 
 int Graph::get_edge_id(int from, int to) const {
-    if(from > to) swap(from, to);
+    if(from < 0 || to < 0 || from >= n || to >= n) return -1;
+    const int arc = find_arc(from, to);
+    return arc == -1 ? -1 : adjacency.edge_ids[arc];
+}
+
+Graph::ArcRange Graph::neighbors(int node) const {
+    update_adjacency();
+    return {&adjacency, adjacency.offsets[node], adjacency.offsets[node + 1]};
+}
+
+int Graph::find_arc(int from, int to) const {
+    update_adjacency();
+    return find_arc_in(adjacency, from, to);
+}
+
+bool Graph::is_connected(int from, int to) const { return find_arc(from, to) != -1; }
+
+Graph::Adjacency& Graph::get_adjacency() {
+    update_adjacency();
+    return adjacency;
+}
+const Graph::Adjacency& Graph::get_adjacency() const {
+    update_adjacency();
+    return adjacency;
+}
+
+void Graph::update_adjacency() const {
+    if(!adjacency_dirty) return;
+    build_adjacency(n, edges, adjacency);
+    adjacency_dirty = false;
+}
+
+void Graph::build_adjacency(int n, const vector<Edge>& edges, Adjacency& adjacency) {
+    // Two stable counting sorts (by target, then by source) give the rows
+    // already sorted by target, with the later edges after the earlier ones.
+    // The edges with an end out of the nodes get no arcs.
     const int m = edges.size();
-    for(int i = 0; i < m; i++)
-        if(edges[i].first == from && edges[i].second == to)
-            return i;
-    return -1;
+    vector<pair<int, int>> arcs;
+    arcs.reserve(2 * m);
+    for(int i = 0; i < m; i++) {
+        if(edges[i].first < 0 || edges[i].second < 0 ||
+            edges[i].first >= n || edges[i].second >= n) continue;
+        arcs.push_back({edges[i].first, i});
+        if(edges[i].first != edges[i].second)
+            arcs.push_back({edges[i].second, i});
+    }
+    const auto target = [&](const pair<int, int>& arc) {
+        const Edge& edge = edges[arc.second];
+        return edge.first == arc.first ? edge.second : edge.first;
+    };
+
+    vector<int> counts(n + 1);
+    vector<pair<int, int>> by_target(arcs.size());
+    for(const auto& arc : arcs) counts[target(arc) + 1]++;
+    for(int i = 0; i < n; i++) counts[i + 1] += counts[i];
+    for(const auto& arc : arcs) by_target[counts[target(arc)]++] = arc;
+
+    fill(counts.begin(), counts.end(), 0);
+    for(const auto& arc : arcs) counts[arc.first + 1]++;
+    for(int i = 0; i < n; i++) counts[i + 1] += counts[i];
+    for(const auto& arc : by_target) arcs[counts[arc.first]++] = arc;
+
+    // The repeated edges are merged, the last added one wins
+    adjacency.offsets.assign(n + 1, 0);
+    adjacency.neighbors.clear();
+    adjacency.weights.clear();
+    adjacency.edge_ids.clear();
+    adjacency.neighbors.reserve(arcs.size());
+    adjacency.weights.reserve(arcs.size());
+    adjacency.edge_ids.reserve(arcs.size());
+    for(int i = 0; i < arcs.size(); i++) {
+        const int to = target(arcs[i]);
+        const T weight = edges[arcs[i].second].weight;
+        const int row = arcs[i].first;
+        if(i > 0 && arcs[i - 1].first == row && adjacency.neighbors.back() == to) {
+            adjacency.weights.back() = weight;
+            continue;
+        }
+        adjacency.neighbors.push_back(to);
+        adjacency.weights.push_back(weight);
+        adjacency.edge_ids.push_back(arcs[i].second);
+        adjacency.offsets[row + 1]++;
+    }
+    for(int i = 0; i < n; i++)
+        adjacency.offsets[i + 1] += adjacency.offsets[i];
+}
+
+bool Graph::assign_edge_ids(const vector<Edge>& edges, Adjacency& adjacency) {
+    adjacency.edge_ids.assign(adjacency.neighbors.size(), -1);
+    // Backwards, so the first of the repeated edges is left. The last one
+    // is met first, its weight is the one build_adjacency keeps.
+    for(int i = (int) edges.size() - 1; i >= 0; i--) {
+        const int forward = find_arc_in(adjacency, edges[i].first, edges[i].second);
+        const int backward = find_arc_in(adjacency, edges[i].second, edges[i].first);
+        if(forward == -1 || backward == -1) return false;
+        for(const int arc : {forward, backward}) {
+            if(adjacency.edge_ids[arc] == -1 && adjacency.weights[arc] != edges[i].weight) return false;
+            adjacency.edge_ids[arc] = i;
+        }
+    }
+    // No arc without its edge
+    for(const int id : adjacency.edge_ids)
+        if(id == -1) return false;
+    return true;
 }
 
 bool Graph::includes(const Graph& graph) const {
-    if(graph.connections.size() > connections.size()) return false;
+    if(graph.n > n) return false;
     set<Edge> mine(edges.begin(), edges.end());
     for(auto edge : graph.edges)
         if(!mine.count(edge)) return false;
@@ -79,70 +279,236 @@ string Graph::to_string() const {
 
 string Graph::to_info_string() const {
     stringstream ss;
-    ss<<"Graph(n="<<connections.size()<<"; m="<<edges.size()<<");";
+    ss<<"Graph(n="<<n<<"; m="<<edges.size()<<");";
     return ss.str();
 }
 
 bool Graph::from_string(const string& s, Graph& graph) {
+    vector<Edge> edges;
+    const int n = parse_edges(s, edges);
+    if(n == 0) return false;
+    graph = Graph(n, move(edges));
+    return true;
+}
+
+int Graph::parse_edges(string_view data, vector<Edge>& edges) {
     int n = -1;
-    set<Edge> edges;
-    stringstream ss(s);
-    for (string line; getline(ss, line); ) {
-        if(line.empty()) continue;
-        static const regex edge("(\\d+)\\s+(\\d+)\\s*(\\d*)");
-        smatch match;
-        if(!regex_search(line, match, edge)) continue;
-        if(match.size() != 3 && match.size() != 4) continue;
-
-        int weight;
-        if(match[3].str().empty()) weight = 1;
-        else weight = stoi(match[3]);
-        Edge to_push = {stoi(match[1]), stoi(match[2]), weight};
-        
-        edges.insert(to_push);
+    edges.clear();
+    size_t pos = 0;
+    int values[3];
+    for (string_view line; next_line(data, pos, line); ) {
+        const int count = parse_int_tuple(line, values);
+        if(count == 0) continue;
+
+        const Edge to_push = {values[0], values[1], count == 3 ? values[2] : 1};
+        edges.push_back(to_push);
         if (n < to_push.first) n = to_push.first;
         if (n < to_push.second) n = to_push.second;
     }
-    if(n == -1) return false;
-    graph = Graph(n + 1, {edges.begin(), edges.end()});
+
+    // Only the first of the repeated edges is kept
+    stable_sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+        return a.first == b.first && a.second == b.second;
+    }), edges.end());
+    return n + 1;
+}
+
+bool Graph::save_binary(const string& filename) const {
+    return GraphSnapshot::write(filename, n, edges, get_adjacency());
+}
+
+bool Graph::load_binary(const string& filename, Graph& graph) {
+    GraphSnapshot snapshot;
+    if(!snapshot.open(filename)) return false;
+    const auto& header = snapshot.get_header();
+
+    Graph buff(header.n);
+    buff.edges.resize(header.m);
+    const int32_t* edges = snapshot.edges();
+    for(int i = 0; i < header.m; i++)
+        buff.edges[i] = {edges[3 * i], edges[3 * i + 1], edges[3 * i + 2]};
+
+    // The stored adjacency is taken as it is, no rebuild is needed
+    buff.adjacency.offsets.assign(snapshot.offsets(), snapshot.offsets() + header.n + 1);
+    buff.adjacency.neighbors.assign(snapshot.neighbors(), snapshot.neighbors() + header.arcs);
+    buff.adjacency.weights.assign(snapshot.weights(), snapshot.weights() + header.arcs);
+    if(!Graph::assign_edge_ids(buff.edges, buff.adjacency)) return false;
+    buff.adjacency_dirty = false;
+
+    graph = move(buff);
+    return true;
+}
+
+
+GraphSnapshot::GraphSnapshot(): file(), header(nullptr) {}
+
+bool GraphSnapshot::open(const string& filename) {
+    header = nullptr;
+    if(!file.open(filename)) return false;
+    if(file.size() < sizeof(Header)) return false;
+
+    const Header* buff = reinterpret_cast<const Header*>(file.data());
+    if(string_view(buff->magic, 4) != "GRPH" || buff->version != VERSION) return false;
+    if(buff->n < 0 || buff->m < 0 || buff->arcs < 0) return false;
+
+    size_t expected = sizeof(Header) + sizeof(int32_t) * (
+        (size_t) buff->n + 1 + 2 * (size_t) buff->arcs + 3 * (size_t) buff->m);
+    if(buff->flags & HAS_COORDINATES)
+        expected += sizeof(float) * 2 * (size_t) buff->n;
+    if(file.size() != expected) return false;
+
+    header = buff;
+    if(!is_valid()) {
+        header = nullptr;
+        return false;
+    }
     return true;
 }
 
-SparseGraph::SparseGraph(): n(0), m(0), edges() {}
-SparseGraph::SparseGraph(int n, int m): n(n), m(m), edges() {}
-SparseGraph::SparseGraph(int n, const vector<Edge>& edges): n(n), m(edges.size()), edges() {
+bool GraphSnapshot::is_valid() const {
+    // Everything the loaders and the lookups rely on: the monotone offsets,
+    // the rows sorted by the target with no repeats, all the nodes in range
+    const int n = header->n;
+    const int32_t* row_offsets = offsets();
+    const int32_t* targets = neighbors();
+    if(row_offsets[0] != 0 || row_offsets[n] != header->arcs) return false;
+    for(int node = 0; node < n; node++) {
+        const int32_t first = row_offsets[node], last = row_offsets[node + 1];
+        if(last < first) return false;
+        for(int32_t arc = first; arc < last; arc++) {
+            if(targets[arc] < 0 || targets[arc] >= n) return false;
+            if(arc > first && targets[arc] <= targets[arc - 1]) return false;
+        }
+    }
+
+    const int32_t* edges_data = edges();
+    for(size_t i = 0; i < 2 * (size_t) header->m; i++) {
+        const int32_t node = edges_data[i / 2 * 3 + i % 2];
+        if(node < 0 || node >= n) return false;
+    }
+    return true;
+}
+
+const int32_t* GraphSnapshot::get_array(size_t offset) const {
+    return reinterpret_cast<const int32_t*>(file.data() + sizeof(Header)) + offset;
+}
+
+const GraphSnapshot::Header& GraphSnapshot::get_header() const { return *header; }
+const int32_t* GraphSnapshot::offsets() const { return get_array(0); }
+const int32_t* GraphSnapshot::neighbors() const { return get_array(header->n + 1); }
+const int32_t* GraphSnapshot::weights() const {
+    return get_array(header->n + 1 + (size_t) header->arcs);
+}
+const int32_t* GraphSnapshot::edges() const {
+    return get_array(header->n + 1 + 2 * (size_t) header->arcs);
+}
+const float* GraphSnapshot::coordinates() const {
+    if(!(header->flags & HAS_COORDINATES)) return nullptr;
+    return reinterpret_cast<const float*>(
+        get_array(header->n + 1 + 2 * (size_t) header->arcs + 3 * (size_t) header->m));
+}
+
+bool GraphSnapshot::write(
+    const string& filename, int n, const vector<Graph::Edge>& edges,
+    const Graph::Adjacency& adjacency, const vector<float>* coordinates
+) {
+    if(coordinates != nullptr && coordinates->size() != 2 * n) return false;
+
+    Header header = {{'G', 'R', 'P', 'H'}, VERSION, 0, n, (int32_t) edges.size(),
+        (int32_t) adjacency.neighbors.size()};
+    if(coordinates != nullptr) header.flags |= HAS_COORDINATES;
+
+    vector<int32_t> edges_data;
+    edges_data.reserve(3 * edges.size());
+    for(const auto& edge : edges) {
+        edges_data.push_back(edge.first);
+        edges_data.push_back(edge.second);
+        edges_data.push_back(edge.weight);
+    }
+
+    ofstream file(filename, ios::binary);
+    if(!file) return false;
+    const auto write_array = [&](const void* data, size_t size) {
+        if(size > 0) file.write(static_cast<const char*>(data), size);
+    };
+    write_array(&header, sizeof(Header));
+    write_array(adjacency.offsets.data(), sizeof(int32_t) * adjacency.offsets.size());
+    write_array(adjacency.neighbors.data(), sizeof(int32_t) * adjacency.neighbors.size());
+    write_array(adjacency.weights.data(), sizeof(int32_t) * adjacency.weights.size());
+    write_array(edges_data.data(), sizeof(int32_t) * edges_data.size());
+    if(coordinates != nullptr)
+        write_array(coordinates->data(), sizeof(float) * coordinates->size());
+    return file.good();
+}
+
+
+SparseGraph::SparseGraph(): n(0), m(0), edges(), index(), adjacency(), adjacency_dirty(true) {}
+SparseGraph::SparseGraph(int n, int m): n(n), m(m), edges(), index(), adjacency(), adjacency_dirty(true) {
+    this->edges.reserve(m);
+    index.reserve(m);
+}
+SparseGraph::SparseGraph(int n, const vector<Edge>& edges): SparseGraph(n) {
+    this->edges.reserve(edges.size());
+    index.reserve(edges.size());
     for(auto edge : edges)
-        this->edges[{edge.first, edge.second}] = edge;
+        set_edge(edge);
 }
 
-bool SparseGraph::is_connected(int from, int to) {
-    if(from > to) swap(from, to);
-    return edges.count({from, to});
+bool SparseGraph::is_connected(int from, int to) const {
+    return index.find(from, to) != -1;
 }
 
-SparseGraph::Edge& SparseGraph::get_edge(int from, int to) {
-    if(from > to) swap(from, to);
-    return edges[{from, to}];
+int SparseGraph::get_edge_id(int from, int to) const {
+    return index.find(from, to);
+}
+
+const SparseGraph::Edge& SparseGraph::get_edge(int from, int to) const {
+    static const Edge none;
+    const int id = index.find(from, to);
+    if(id == -1) return none;
+    return edges[id];
+}
+
+Graph::ArcRange SparseGraph::neighbors(int node) const {
+    update_adjacency();
+    return {&adjacency, adjacency.offsets[node], adjacency.offsets[node + 1]};
+}
+
+void SparseGraph::update_adjacency() const {
+    if(!adjacency_dirty) return;
+    Graph::build_adjacency(n, edges, adjacency);
+    adjacency_dirty = false;
 }
 
 void SparseGraph::set_edge(Edge edge) {
-    if(is_connected(edge.first, edge.second)) {
+    const int id = index.find(edge.first, edge.second);
+    if(id != -1) {
         if (!edge.connected) {
-            edges.erase({edge.first, edge.second});
+            // Moving the last edge into the freed place
+            const Edge& last = edges.back();
+            index.erase(edge.first, edge.second);
+            if(id != edges.size() - 1) {
+                index.insert(last.first, last.second, id);
+                edges[id] = last;
+            }
+            edges.pop_back();
             m--;
         }
-        else edges[{edge.first, edge.second}].weight = edge.weight;
+        else edges[id].weight = edge.weight;
     }
     else if(edge.connected) {
-        edges[{edge.first, edge.second}] = edge;
+        index.insert(edge.first, edge.second, edges.size());
+        edges.push_back(edge);
         m++;
     }
+    adjacency_dirty = true;
 }
 
 string SparseGraph::to_string() const {
     stringstream ss;
     for(auto edge : edges) {
-        ss << edge.second.first << " " << edge.second.second << " " << edge.second.weight << "\n";
+        ss << edge.first << " " << edge.second << " " << edge.weight << "\n";
     }
     return ss.str();
 }
@@ -154,28 +520,44 @@ string SparseGraph::to_info_string() const {
 }
 
 bool SparseGraph::from_string(const string& s, SparseGraph& graph) {
-    int n = -1;
-    set<Edge> edges;
-    stringstream ss(s);
-    for (string line; getline(ss, line); ) {
-        if(line.empty()) continue;
-        static const regex edge("(\\d+)\\s+(\\d+)\\s*(\\d*)");
-        smatch match;
-        if(!regex_search(line, match, edge)) continue;
-        if(match.size() != 3 && match.size() != 4) continue;
-
-        int weight;
-        if(match[3].str().empty()) weight = 1;
-        else weight = stoi(match[3]);
-        Edge to_push = {stoi(match[1]), stoi(match[2]), weight};
-        
-        edges.insert(to_push);
-        if (n < to_push.first) n = to_push.first;
-        if (n < to_push.second) n = to_push.second;
+    vector<Edge> edges;
+    const int n = Graph::parse_edges(s, edges);
+    if(n == 0) return false;
+    graph = SparseGraph(n, edges);
+    return true;
+}
+
+bool SparseGraph::save_binary(const string& filename, const vector<float>* coordinates) const {
+    update_adjacency();
+    return GraphSnapshot::write(filename, n, edges, adjacency, coordinates);
+}
+
+bool SparseGraph::load_binary(const string& filename, SparseGraph& graph) {
+    GraphSnapshot snapshot;
+    if(!snapshot.open(filename)) return false;
+    return load_binary(snapshot, graph);
+}
+
+bool SparseGraph::load_binary(const GraphSnapshot& snapshot, SparseGraph& graph) {
+    const auto& header = snapshot.get_header();
+    SparseGraph buff(header.n, 0);
+    buff.edges.resize(header.m);
+    buff.index.reserve(header.m);
+    const int32_t* edges = snapshot.edges();
+    for(int i = 0; i < header.m; i++) {
+        buff.edges[i] = {edges[3 * i], edges[3 * i + 1], edges[3 * i + 2]};
+        buff.index.insert(buff.edges[i].first, buff.edges[i].second, i);
     }
-    if(n == -1) return false;
-    graph = SparseGraph(n + 1, {edges.begin(), edges.end()});
+    buff.m = header.m;
+
+    buff.adjacency.offsets.assign(snapshot.offsets(), snapshot.offsets() + header.n + 1);
+    buff.adjacency.neighbors.assign(snapshot.neighbors(), snapshot.neighbors() + header.arcs);
+    buff.adjacency.weights.assign(snapshot.weights(), snapshot.weights() + header.arcs);
+    if(!Graph::assign_edge_ids(buff.edges, buff.adjacency)) return false;
+    buff.adjacency_dirty = false;
+
+    graph = move(buff);
     return true;
 }
 
-const map<pair<int, int>, SparseGraph::Edge> &SparseGraph::get_edges() const { return edges; }
\ No newline at end of file
+const vector<SparseGraph::Edge> &SparseGraph::get_edges() const { return edges; }
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include "instanced_renderer.h"
+
+#include <cstring>
+#include <cstddef>
+
+#ifdef __EMSCRIPTEN__
+#include <GLES3/gl3.h>
+#else
+#include <SDL.h>
+#include <SDL_opengl.h>
+#endif
+
+using namespace std;
+
+// The GL 2+ functions are loaded through SDL on the desktop (the system
+// headers only give GL 1.1 there), and are linked directly on Emscripten.
+#define GL_FUNCTIONS(X) \
+    X(PFNGLCREATESHADERPROC, glCreateShader) \
+    X(PFNGLSHADERSOURCEPROC, glShaderSource) \
+    X(PFNGLCOMPILESHADERPROC, glCompileShader) \
+    X(PFNGLGETSHADERIVPROC, glGetShaderiv) \
+    X(PFNGLDELETESHADERPROC, glDeleteShader) \
+    X(PFNGLCREATEPROGRAMPROC, glCreateProgram) \
+    X(PFNGLATTACHSHADERPROC, glAttachShader) \
+    X(PFNGLBINDATTRIBLOCATIONPROC, glBindAttribLocation) \
+    X(PFNGLLINKPROGRAMPROC, glLinkProgram) \
+    X(PFNGLGETPROGRAMIVPROC, glGetProgramiv) \
+    X(PFNGLUSEPROGRAMPROC, glUseProgram) \
+    X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation) \
+    X(PFNGLUNIFORM2FPROC, glUniform2f) \
+    X(PFNGLGENVERTEXARRAYSPROC, glGenVertexArrays) \
+    X(PFNGLBINDVERTEXARRAYPROC, glBindVertexArray) \
+    X(PFNGLGENBUFFERSPROC, glGenBuffers) \
+    X(PFNGLBINDBUFFERPROC, glBindBuffer) \
+    X(PFNGLBUFFERDATAPROC, glBufferData) \
+    X(PFNGLBUFFERSUBDATAPROC, glBufferSubData) \
+    X(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray) \
+    X(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer) \
+    X(PFNGLVERTEXATTRIBDIVISORPROC, glVertexAttribDivisor) \
+    X(PFNGLDRAWARRAYSINSTANCEDPROC, glDrawArraysInstanced)
+
+namespace {
+    namespace gl {
+        #ifdef __EMSCRIPTEN__
+        #define DECLARE_FUNCTION(type, name) decltype(&::name) name = &::name;
+        #else
+        #define DECLARE_FUNCTION(type, name) type name = nullptr;
+        #endif
+        GL_FUNCTIONS(DECLARE_FUNCTION)
+        #undef DECLARE_FUNCTION
+
+        bool load() {
+            #ifndef __EMSCRIPTEN__
+            if(SDL_GL_GetCurrentContext() == nullptr) return false;
+            #define LOAD_FUNCTION(type, name) name = (type) SDL_GL_GetProcAddress(#name);
+            GL_FUNCTIONS(LOAD_FUNCTION)
+            #undef LOAD_FUNCTION
+            // The instanced arrays are in the core since GL 3.3 only
+            if(glVertexAttribDivisor == nullptr)
+                glVertexAttribDivisor = (PFNGLVERTEXATTRIBDIVISORPROC) SDL_GL_GetProcAddress("glVertexAttribDivisorARB");
+            #define CHECK_FUNCTION(type, name) if(name == nullptr) return false;
+            GL_FUNCTIONS(CHECK_FUNCTION)
+            #undef CHECK_FUNCTION
+            #endif
+            return true;
+        }
+    }
+
+    #if defined(__EMSCRIPTEN__)
+    const char* GLSL_HEADER = "#version 300 es\nprecision mediump float;\n";
+    #elif defined(__APPLE__)
+    const char* GLSL_HEADER = "#version 150\n";
+    #else
+    const char* GLSL_HEADER = "#version 130\n";
+    #endif
+
+    // The quad corners are taken from gl_VertexID of the 4 vertex strip
+    const char* NODE_VERTEX_SHADER = R"(
+        uniform vec2 offset;
+        uniform vec2 scale;
+        uniform vec2 display_pos;
+        uniform vec2 display_size;
+        in vec3 node;
+        in vec4 color;
+        out vec2 local;
+        out float radius;
+        out vec4 node_color;
+        void main() {
+            vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0 - 1.0;
+            // A pixel more for the smoothed border
+            vec2 screen = offset + node.xy * scale + corner * (node.z + 1.0);
+            vec2 ndc = (screen - display_pos) / display_size * 2.0 - 1.0;
+            gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+            local = corner * (node.z + 1.0);
+            radius = node.z;
+            node_color = color;
+        }
+    )";
+    const char* NODE_FRAGMENT_SHADER = R"(
+        in vec2 local;
+        in float radius;
+        in vec4 node_color;
+        out vec4 out_color;
+        void main() {
+            float alpha = clamp(radius - length(local) + 0.5, 0.0, 1.0);
+            if(alpha <= 0.0) discard;
+            out_color = vec4(node_color.rgb, node_color.a * alpha);
+        }
+    )";
+    const char* EDGE_VERTEX_SHADER = R"(
+        uniform vec2 offset;
+        uniform vec2 scale;
+        uniform vec2 display_pos;
+        uniform vec2 display_size;
+        in vec4 edge;
+        in vec4 color;
+        in float width;
+        out vec4 edge_color;
+        void main() {
+            float along = float(gl_VertexID & 1);
+            float across = float(gl_VertexID >> 1) * 2.0 - 1.0;
+            vec2 a = offset + edge.xy * scale;
+            vec2 b = offset + edge.zw * scale;
+            vec2 direction = b - a;
+            float size = length(direction);
+            vec2 normal = size > 0.0 ? vec2(-direction.y, direction.x) / size : vec2(0.0, 1.0);
+            vec2 screen = mix(a, b, along) + normal * across * width * 0.5;
+            vec2 ndc = (screen - display_pos) / display_size * 2.0 - 1.0;
+            gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+            edge_color = color;
+        }
+    )";
+    const char* EDGE_FRAGMENT_SHADER = R"(
+        in vec4 edge_color;
+        out vec4 out_color;
+        void main() { out_color = edge_color; }
+    )";
+
+    unsigned int compile_shader(GLenum type, const char* source) {
+        const GLuint shader = gl::glCreateShader(type);
+        const char* sources[2] = {GLSL_HEADER, source};
+        gl::glShaderSource(shader, 2, sources, nullptr);
+        gl::glCompileShader(shader);
+        GLint status = 0;
+        gl::glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if(!status) {
+            gl::glDeleteShader(shader);
+            return 0;
+        }
+        return shader;
+    }
+
+    unsigned int link_program(const char* vertex_source, const char* fragment_source,
+        const vector<const char*>& attributes
+    ) {
+        const GLuint vertex = compile_shader(GL_VERTEX_SHADER, vertex_source);
+        const GLuint fragment = compile_shader(GL_FRAGMENT_SHADER, fragment_source);
+        if(vertex == 0 || fragment == 0) return 0;
+
+        const GLuint program = gl::glCreateProgram();
+        gl::glAttachShader(program, vertex);
+        gl::glAttachShader(program, fragment);
+        for(int i = 0; i < attributes.size(); i++)
+            gl::glBindAttribLocation(program, i, attributes[i]);
+        gl::glLinkProgram(program);
+        gl::glDeleteShader(vertex);
+        gl::glDeleteShader(fragment);
+        GLint status = 0;
+        gl::glGetProgramiv(program, GL_LINK_STATUS, &status);
+        return status ? program : 0;
+    }
+}
+
+InstancedRenderer::Batch::Batch(): vertex_array(0), buffer(0), capacity(0), count(0), uploaded() {}
+
+InstancedRenderer::InstancedRenderer():
+    state(0), node_program(0), edge_program(0), nodes(), edges(), offset(), scale(1, 1) {}
+
+bool InstancedRenderer::init() {
+    if(!gl::load()) return false;
+    node_program = link_program(NODE_VERTEX_SHADER, NODE_FRAGMENT_SHADER, {"node", "color"});
+    edge_program = link_program(EDGE_VERTEX_SHADER, EDGE_FRAGMENT_SHADER, {"edge", "color", "width"});
+    if(node_program == 0 || edge_program == 0) return false;
+
+    // Every attribute advances once per instance
+    const auto add_attribute = [](int location, int size, GLenum type, bool normalized, int stride, size_t offset) {
+        gl::glEnableVertexAttribArray(location);
+        gl::glVertexAttribPointer(location, size, type, normalized, stride, (const void*) offset);
+        gl::glVertexAttribDivisor(location, 1);
+    };
+
+    gl::glGenVertexArrays(1, &nodes.vertex_array);
+    gl::glGenBuffers(1, &nodes.buffer);
+    gl::glBindVertexArray(nodes.vertex_array);
+    gl::glBindBuffer(GL_ARRAY_BUFFER, nodes.buffer);
+    add_attribute(0, 3, GL_FLOAT, false, sizeof(NodeInstance), offsetof(NodeInstance, point));
+    add_attribute(1, 4, GL_UNSIGNED_BYTE, true, sizeof(NodeInstance), offsetof(NodeInstance, color));
+
+    gl::glGenVertexArrays(1, &edges.vertex_array);
+    gl::glGenBuffers(1, &edges.buffer);
+    gl::glBindVertexArray(edges.vertex_array);
+    gl::glBindBuffer(GL_ARRAY_BUFFER, edges.buffer);
+    add_attribute(0, 4, GL_FLOAT, false, sizeof(EdgeInstance), offsetof(EdgeInstance, from));
+    add_attribute(1, 4, GL_UNSIGNED_BYTE, true, sizeof(EdgeInstance), offsetof(EdgeInstance, color));
+    add_attribute(2, 1, GL_FLOAT, false, sizeof(EdgeInstance), offsetof(EdgeInstance, width));
+
+    gl::glBindVertexArray(0);
+    gl::glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+bool InstancedRenderer::is_available() {
+    if(state == 0) state = init() ? 1 : -1;
+    return state == 1;
+}
+
+void InstancedRenderer::upload(Batch& batch, const void* data, int count, int size) {
+    const char* bytes = static_cast<const char*>(data);
+    gl::glBindBuffer(GL_ARRAY_BUFFER, batch.buffer);
+    if(count > batch.capacity) {
+        batch.capacity = max(count, 2 * batch.capacity);
+        gl::glBufferData(GL_ARRAY_BUFFER, (size_t) batch.capacity * size, nullptr, GL_DYNAMIC_DRAW);
+        gl::glBufferSubData(GL_ARRAY_BUFFER, 0, (size_t) count * size, bytes);
+        batch.uploaded.assign(bytes, bytes + (size_t) count * size);
+    }
+    else {
+        // Only the instances from the first changed one to the last changed one
+        const int common = min(count, batch.count);
+        int first = 0, last = count;
+        while(first < common && memcmp(&batch.uploaded[(size_t) first * size], bytes + (size_t) first * size, size) == 0)
+            first++;
+        if(count == batch.count)
+            while(last > first && memcmp(&batch.uploaded[(size_t) (last - 1) * size], bytes + (size_t) (last - 1) * size, size) == 0)
+                last--;
+        batch.uploaded.resize((size_t) count * size);
+        if(first < last) {
+            gl::glBufferSubData(GL_ARRAY_BUFFER, (size_t) first * size, (size_t) (last - first) * size,
+                bytes + (size_t) first * size);
+            memcpy(&batch.uploaded[(size_t) first * size], bytes + (size_t) first * size, (size_t) (last - first) * size);
+        }
+    }
+    gl::glBindBuffer(GL_ARRAY_BUFFER, 0);
+    batch.count = count;
+}
+
+void InstancedRenderer::set_nodes(const vector<NodeInstance>& instances) {
+    if(!is_available()) return;
+    upload(nodes, instances.data(), instances.size(), sizeof(NodeInstance));
+}
+
+void InstancedRenderer::set_edges(const vector<EdgeInstance>& instances) {
+    if(!is_available()) return;
+    upload(edges, instances.data(), instances.size(), sizeof(EdgeInstance));
+}
+
+void InstancedRenderer::set_transform(Vec2 offset, Vec2 scale) {
+    this->offset = offset;
+    this->scale = scale;
+}
+
+void InstancedRenderer::draw(ImDrawList* draw_list) {
+    if(!is_available()) return;
+    draw_list->AddCallback(&InstancedRenderer::render_callback, this);
+    // The ImGui backend restores its own GL state after the callback
+    draw_list->AddCallback(ImDrawCallback_ResetRenderState, nullptr);
+}
+
+void InstancedRenderer::render_callback(const ImDrawList*, const ImDrawCmd* command) {
+    static_cast<InstancedRenderer*>(command->UserCallbackData)->render(command);
+}
+
+void InstancedRenderer::render(const ImDrawCmd* command) {
+    const ImDrawData* draw_data = ImGui::GetDrawData();
+    const Vec2 display_pos = draw_data->DisplayPos;
+    const Vec2 display_size = draw_data->DisplaySize;
+    const Vec2 framebuffer_scale = draw_data->FramebufferScale;
+
+    // The clip rectangle of the window, in the framebuffer pixels
+    const ImVec4 clip = command->ClipRect;
+    const Vec2 clip_min = (Vec2{clip.x, clip.y} - display_pos) * framebuffer_scale;
+    const Vec2 clip_max = (Vec2{clip.z, clip.w} - display_pos) * framebuffer_scale;
+    if(clip_max.x <= clip_min.x || clip_max.y <= clip_min.y) return;
+    glEnable(GL_SCISSOR_TEST);
+    glScissor((int) clip_min.x, (int) (display_size.y * framebuffer_scale.y - clip_max.y),
+        (int) (clip_max.x - clip_min.x), (int) (clip_max.y - clip_min.y));
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    const auto draw_batch = [&](unsigned int program, const Batch& batch) {
+        if(batch.count == 0) return;
+        gl::glUseProgram(program);
+        gl::glUniform2f(gl::glGetUniformLocation(program, "offset"), offset.x, offset.y);
+        gl::glUniform2f(gl::glGetUniformLocation(program, "scale"), scale.x, scale.y);
+        gl::glUniform2f(gl::glGetUniformLocation(program, "display_pos"), display_pos.x, display_pos.y);
+        gl::glUniform2f(gl::glGetUniformLocation(program, "display_size"), display_size.x, display_size.y);
+        gl::glBindVertexArray(batch.vertex_array);
+        gl::glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, batch.count);
+    };
+    draw_batch(edge_program, edges);
+    draw_batch(node_program, nodes);
+    gl::glBindVertexArray(0);
+}
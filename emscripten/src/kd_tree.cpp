@@ -0,0 +1,63 @@
+#include "kd_tree.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+    inline float get_axis(const Vec2& point, int axis) { return axis == 0 ? point.x : point.y; }
+}
+
+KdTree::KdTree(): positions(), order() {}
+
+void KdTree::build(const vector<Vec2>& points) {
+    positions = points;
+    order.resize(points.size());
+    for(int i = 0; i < order.size(); i++) order[i] = i;
+    build(0, order.size(), 0);
+}
+
+void KdTree::build(int first, int last, int axis) {
+    while(last - first > 1) {
+        const int middle = (first + last) / 2;
+        nth_element(order.begin() + first, order.begin() + middle, order.begin() + last,
+            [&](int a, int b) { return get_axis(positions[a], axis) < get_axis(positions[b], axis); });
+        build(first, middle, 1 - axis);
+        first = middle + 1;
+        axis = 1 - axis;
+    }
+}
+
+int KdTree::nearest(const Vec2& point, const Vec2& scale, float max_distance) const {
+    // bound is the scaled squared distance to the split line of the parent
+    struct Range { int first, last, axis; float bound; };
+    // The depth is about log2(n), so 64 is enough
+    Range stack[64];
+    int top = 0;
+    if(!order.empty()) stack[top++] = {0, (int) order.size(), 0, 0};
+
+    int ret = -1;
+    float best = max_distance * max_distance;
+    while(top > 0) {
+        const Range range = stack[--top];
+        if(range.first >= range.last || range.bound >= best) continue;
+        const int middle = (range.first + range.last) / 2;
+        const Vec2& median = positions[order[middle]];
+
+        const float dx = (median.x - point.x) * scale.x, dy = (median.y - point.y) * scale.y;
+        const float distance = dx * dx + dy * dy;
+        if(distance < best) {
+            best = distance;
+            ret = order[middle];
+        }
+
+        // The near side is visited first, the far one only if the split
+        // line is still closer than the best point then
+        const float split = range.axis == 0 ? -dx : -dy;
+        const Range lower = {range.first, middle, 1 - range.axis, split < 0 ? 0 : split * split};
+        const Range upper = {middle + 1, range.last, 1 - range.axis, split < 0 ? split * split : 0};
+        stack[top++] = split < 0 ? upper : lower;
+        stack[top++] = split < 0 ? lower : upper;
+    }
+    return ret;
+}
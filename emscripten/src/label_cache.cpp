@@ -0,0 +1,47 @@
+#include "label_cache.h"
+
+#include "imgui.h"
+
+using namespace std;
+
+LabelCache::Entry::Entry(): is_set(false), value(0), label() {}
+
+LabelCache::LabelCache(): entries(), font_size(0) {}
+
+LabelCache::Entry& LabelCache::get_entry(int graph_id, Kind kind, int element) {
+    const float current_font_size = ImGui::GetFontSize();
+    if(current_font_size != font_size) {
+        clear();
+        font_size = current_font_size;
+    }
+
+    const int list = graph_id * KINDS_COUNT + kind;
+    if(list >= entries.size()) entries.resize(list + 1);
+    if(element >= entries[list].size()) entries[list].resize(element + 1);
+    return entries[list][element];
+}
+
+const LabelCache::Label& LabelCache::get(int graph_id, Kind kind, int element, int value) {
+    Entry& entry = get_entry(graph_id, kind, element);
+    if(!entry.is_set || entry.value != value) {
+        entry.is_set = true;
+        entry.value = value;
+        entry.label.text = to_string(value);
+        entry.label.size = ImGui::CalcTextSize(entry.label.text.c_str());
+    }
+    return entry.label;
+}
+
+const LabelCache::Label& LabelCache::get(int graph_id, Kind kind, int element, const string& text) {
+    Entry& entry = get_entry(graph_id, kind, element);
+    if(!entry.is_set || entry.label.text != text) {
+        entry.is_set = true;
+        entry.label.text = text;
+        entry.label.size = ImGui::CalcTextSize(text.c_str());
+    }
+    return entry.label;
+}
+
+void LabelCache::clear() {
+    entries.clear();
+}
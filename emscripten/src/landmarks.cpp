@@ -0,0 +1,127 @@
+#include "landmarks.h"
+
+#include "thread_pool.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <functional>
+
+using namespace std;
+
+const int Landmarks::UNREACHABLE = -1;
+const int Landmarks::DEFAULT_COUNT = 16;
+
+Landmarks::Landmarks(): n(0), nodes(), distances() {}
+
+void Landmarks::compute_distances(const SparseGraph& graph, int source, vector<Graph::T>& distances) {
+    using T = Graph::T;
+    distances.assign(graph.n, UNREACHABLE);
+    priority_queue<pair<T, int>, vector<pair<T, int>>, greater<pair<T, int>>> queue;
+    distances[source] = 0;
+    queue.push({0, source});
+    while(!queue.empty()) {
+        const auto [distance, node] = queue.top();
+        queue.pop();
+        if(distance > distances[node]) continue;
+        for(const auto arc : graph.neighbors(node)) {
+            const T next = distance + arc.weight;
+            if(distances[arc.to] == UNREACHABLE || next < distances[arc.to]) {
+                distances[arc.to] = next;
+                queue.push({next, arc.to});
+            }
+        }
+    }
+}
+
+bool Landmarks::build(
+    const SparseGraph& graph, const vector<Vec2>& coordinates, int count,
+    AlgorithmJob::Control* control
+) {
+    clear();
+    const int n = graph.n;
+    if(n == 0 || count <= 0) return true;
+    // Built before the threads read it
+    graph.neighbors(0);
+
+    // The isolated nodes (like the unused 0 of the text format) are no use
+    const auto is_connected = [&](int node) { return graph.neighbors(node).size() > 0; };
+    vector<int> picked;
+    if(coordinates.size() >= n) {
+        Vec2 center;
+        int connected = 0;
+        for(int node = 0; node < n; node++) {
+            if(!is_connected(node)) continue;
+            center += coordinates[node];
+            connected++;
+        }
+        if(connected > 0) center = center / connected;
+
+        vector<int> farthest(count, -1);
+        vector<float> farthest_distance(count, -1);
+        for(int node = 0; node < n; node++) {
+            if(!is_connected(node)) continue;
+            const Vec2 offset = coordinates[node] - center;
+            const float angle = atan2(offset.y, offset.x) + PI;
+            const int sector = min(count - 1, (int) (angle / (2 * PI) * count));
+            const float distance = offset.abs();
+            if(distance > farthest_distance[sector]) {
+                farthest_distance[sector] = distance;
+                farthest[sector] = node;
+            }
+        }
+        for(int node : farthest)
+            if(node != -1) picked.push_back(node);
+    }
+    else {
+        // No coordinates, spread over the ids
+        for(int i = 0; i < count; i++) {
+            const int node = (long long) i * n / count;
+            if(is_connected(node)) picked.push_back(node);
+        }
+    }
+
+    const int k = picked.size();
+    vector<Graph::T> table((size_t) n * k);
+    ThreadPool pool;
+    pool.parallel_for(k, 1, [&](int first, int last) {
+        vector<Graph::T> buff;
+        for(int i = first; i < last; i++) {
+            if(control != nullptr && control->is_cancelled()) return;
+            compute_distances(graph, picked[i], buff);
+            for(int node = 0; node < n; node++)
+                table[(size_t) node * k + i] = buff[node];
+            if(control != nullptr) control->add_progress();
+        }
+    });
+    if(control != nullptr && control->is_cancelled()) return false;
+
+    this->n = n;
+    nodes = move(picked);
+    distances = move(table);
+    return true;
+}
+
+void Landmarks::clear() {
+    n = 0;
+    nodes.clear();
+    distances.clear();
+}
+
+bool Landmarks::is_built() const { return n > 0 && !nodes.empty(); }
+
+const vector<int>& Landmarks::get_nodes() const { return nodes; }
+
+Graph::T Landmarks::get_lower_bound(int a, int b) const {
+    const int k = nodes.size();
+    const Graph::T* row_a = distances.data() + (size_t) a * k;
+    const Graph::T* row_b = distances.data() + (size_t) b * k;
+    Graph::T bound = 0;
+    for(int i = 0; i < k; i++) {
+        // A landmark in another component tells nothing
+        if(row_a[i] == UNREACHABLE || row_b[i] == UNREACHABLE) continue;
+        bound = max(bound, abs(row_a[i] - row_b[i]));
+    }
+    return bound;
+}
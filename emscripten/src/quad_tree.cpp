@@ -0,0 +1,85 @@
+#include "quad_tree.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+QuadTree::Node::Node(Vec2 min, float size):
+    mass_center(), mass(0), min(min), size(size), children(-1), point(-1) {}
+
+QuadTree::QuadTree(): nodes(), positions() {}
+
+void QuadTree::build(const vector<Vec2>& points) {
+    nodes.clear();
+    positions = points;
+    if(points.empty()) return;
+
+    Vec2 lo = points[0], hi = points[0];
+    for(const auto& point : points) {
+        lo = {std::min(lo.x, point.x), std::min(lo.y, point.y)};
+        hi = {std::max(hi.x, point.x), std::max(hi.y, point.y)};
+    }
+    nodes.reserve(2 * points.size());
+    nodes.push_back(Node(lo, std::max(hi.x - lo.x, hi.y - lo.y) + 1));
+    for(int i = 0; i < points.size(); i++)
+        insert(0, i, 0);
+
+    // The sums of the positions become the mass centers
+    for(auto& node : nodes)
+        if(node.mass > 0) node.mass_center = node.mass_center / node.mass;
+}
+
+void QuadTree::split(int node) {
+    const float half = nodes[node].size / 2;
+    const Vec2 min = nodes[node].min;
+    nodes[node].children = nodes.size();
+    nodes.push_back(Node(min, half));
+    nodes.push_back(Node(min + Vec2{half, 0}, half));
+    nodes.push_back(Node(min + Vec2{0, half}, half));
+    nodes.push_back(Node(min + Vec2{half, half}, half));
+}
+
+void QuadTree::insert(int node, int point, int depth) {
+    const Vec2& position = positions[point];
+    while(true) {
+        nodes[node].mass_center += position;
+        nodes[node].mass += 1;
+
+        if(nodes[node].children == -1) {
+            if(nodes[node].mass == 1) {
+                nodes[node].point = point;
+                return;
+            }
+            if(depth >= MAX_DEPTH) {
+                nodes[node].point = -1;
+                return;
+            }
+
+            // Pushing the old point one level down
+            const int old_point = nodes[node].point;
+            nodes[node].point = -1;
+            split(node);
+            if(old_point != -1) {
+                const Vec2& old_position = positions[old_point];
+                const Vec2 rel = old_position - nodes[node].min;
+                const float half = nodes[node].size / 2;
+                const int child = nodes[node].children + (rel.x >= half) + 2 * (rel.y >= half);
+                nodes[child].mass_center += old_position;
+                nodes[child].mass += 1;
+                nodes[child].point = old_point;
+            }
+        }
+
+        const Vec2 rel = position - nodes[node].min;
+        const float half = nodes[node].size / 2;
+        node = nodes[node].children + (rel.x >= half) + 2 * (rel.y >= half);
+        depth++;
+    }
+}
+
+float QuadTree::get_distance(const Node& node, const Vec2& point) {
+    const float dx = std::max({node.min.x - point.x, 0.0f, point.x - node.min.x - node.size});
+    const float dy = std::max({node.min.y - point.y, 0.0f, point.y - node.min.y - node.size});
+    return sqrt(dx * dx + dy * dy);
+}
@@ -0,0 +1,35 @@
+#include "search_context.h"
+
+using namespace std;
+
+SearchContext::Side::Side(): labels(), heap(), stamp(0) {}
+
+void SearchContext::Side::reset(int n) {
+    if(labels.size() != n) {
+        labels.assign(n, {0, -1, -1, 0, 0});
+        stamp = 0;
+    }
+    // After the wrap around the old stamps could match again
+    if(++stamp == 0) {
+        for(auto& label : labels) label.reached = label.settled = 0;
+        stamp = 1;
+    }
+    heap.clear();
+}
+
+SearchContext::SearchContext(): sides(), checked_stamps(), stamp(0), checked_nodes() {}
+
+void SearchContext::reset(int n) {
+    sides[0].reset(n);
+    sides[1].reset(n);
+
+    if(checked_stamps.size() != n) {
+        checked_stamps.assign(n, 0);
+        stamp = 0;
+    }
+    if(++stamp == 0) {
+        fill(checked_stamps.begin(), checked_stamps.end(), 0);
+        stamp = 1;
+    }
+    checked_nodes.clear();
+}
@@ -4,36 +4,49 @@
 #include "imgui_internal.h"
 #include "misc/cpp/imgui_stdlib.h"
 
+#include "utils.h"
+
+#include <algorithm>
+
 using Edge = Graph::Edge;
 
-SparseGraphView::SparseGraphView(): graph(), coordinates(), bounds(),
-    current_path(), selected_nodes() {}
+namespace {
+    const ImU32 edge_color = ImColor(.3f, .3f, .3f, .3f);
+    const ImU32 node_color = ImColor(1.0f, 1.0f, 1.0f, 1.0f);
+    const ImU32 selected_color = ImColor(.0f, .8f, .0f, 1.0f);
+    const ImU32 start_color = ImColor(.3f, .6f, 1.0f, 1.0f);
+    const ImU32 end_color = ImColor(1.0f, .3f, .3f, 1.0f);
+}
+
+const float SparseGraphView::MIN_ZOOM = 0.5f;
+const float SparseGraphView::MAX_ZOOM = 200.0f;
+const float SparseGraphView::PICK_RADIUS = 10.0f;
+
+SparseGraphView::SparseGraphView(): graph(), coordinates(), bounds(), hierarchy(), landmarks(),
+    current_path(), selected_nodes(), nodes_selection(), selection_dirty(false), renderer(), static_dirty(true),
+    cached_geometry(), cached_scale(), cached_white_pixel(),
+    zoom(1), pan(), nodes_index(), picked_start(-1), picked_end(-1), picked_changed(false) {}
 
-bool SparseGraphView::load_graph(string data, const int first_node_index) {
-    set<Edge> edges;
+bool SparseGraphView::load_graph(string_view data, const int first_node_index) {
     vector<Vec2> coordinates;
     Vec2 bounds;
-    stringstream ss(data);
     int n = -1, m = -1;
     int coordinate_index = first_node_index;
-    for (string line; getline(ss, line); ) {
+    int values[3];
+    size_t pos = 0, edges_pos = data.size();
+    for (string_view line; edges_pos == data.size() && next_line(data, pos, line); ) {
         if(line.empty()) continue;
-        smatch match;
         if(n == -1) {
-            static const regex r("(\\d+)\\s+(\\d+)");
-            if(!regex_search(line, match, r)) return false;
-            if(match.size() != 3) return false;
-            n = stoi(match[1]);
-            m = stoi(match[2]);
+            if(parse_int_tuple(line, values) == 0) return false;
+            n = values[0];
+            m = values[1];
             coordinates = vector<Vec2>(n+1);
             continue;
         }
         else if(coordinate_index < n + first_node_index) {
-            static const regex r("(\\d+)\\s+(\\d+)");
-            if(!regex_search(line, match, r)) return false;
-            if(match.size() != 3) return false;
-            coordinates[coordinate_index].x = stoi(match[1]);
-            coordinates[coordinate_index].y = stoi(match[2]);
+            if(parse_int_tuple(line, values) == 0) return false;
+            coordinates[coordinate_index].x = values[0];
+            coordinates[coordinate_index].y = values[1];
             if(bounds.x < coordinates[coordinate_index].x)
                 bounds.x = coordinates[coordinate_index].x;
             if(bounds.y < coordinates[coordinate_index].y)
@@ -42,22 +55,67 @@ bool SparseGraphView::load_graph(string data, const int first_node_index) {
             continue;
         }
 
-        static const regex edge("(\\d+)\\s+(\\d+)\\s*(\\d*)");
-        if(!regex_search(line, match, edge)) continue;
-        if(match.size() != 3 && match.size() != 4) continue;
-
-        int weight;
-        if(match[3].str().empty()) weight = 1;
-        else weight = stoi(match[3]);
-        Edge to_push = {stoi(match[1]), stoi(match[2]), weight};
-        edges.insert(to_push);
+        edges_pos = line.data() - data.data();
     }
 
-    graph = SparseGraph(n+1, {edges.begin(), edges.end()});
+    vector<Edge> edges;
+    if(m > 0) edges.reserve(m);
+    Graph::parse_edges(data.substr(edges_pos), edges);
+    for(const auto& edge : edges)
+        if(edge.first < 0 || edge.second > n) return false;
+
+    graph = SparseGraph(n+1, edges);
     this->coordinates = coordinates;
     this->bounds = bounds;
 
-    selected_nodes.resize(graph.n);
+    hierarchy.clear();
+    landmarks.clear();
+    static_dirty = true;
+    nodes_index.build(this->coordinates);
+    zoom = 1;
+    pan = {0, 0};
+    picked_start = picked_end = -1;
+    clear_selection();
+    return true;
+}
+
+bool SparseGraphView::load_graph_file(const string& filename, const int first_node_index) {
+    // Parsed straight from the mapping, the text is never copied
+    MappedFile file;
+    if(!file.open(filename)) return false;
+    return load_graph(string_view(file.data(), file.size()), first_node_index);
+}
+
+bool SparseGraphView::save_snapshot(const string& filename) const {
+    vector<float> coordinates_data(2 * graph.n);
+    for(int i = 0; i < graph.n && i < coordinates.size(); i++) {
+        coordinates_data[2 * i] = coordinates[i].x;
+        coordinates_data[2 * i + 1] = coordinates[i].y;
+    }
+    return graph.save_binary(filename, &coordinates_data);
+}
+
+bool SparseGraphView::load_snapshot(const string& filename) {
+    GraphSnapshot snapshot;
+    if(!snapshot.open(filename) || snapshot.coordinates() == nullptr) return false;
+    if(!SparseGraph::load_binary(snapshot, graph)) return false;
+
+    const float* coordinates_data = snapshot.coordinates();
+    coordinates.resize(graph.n);
+    bounds = Vec2();
+    for(int i = 0; i < graph.n; i++) {
+        coordinates[i] = {coordinates_data[2 * i], coordinates_data[2 * i + 1]};
+        if(bounds.x < coordinates[i].x) bounds.x = coordinates[i].x;
+        if(bounds.y < coordinates[i].y) bounds.y = coordinates[i].y;
+    }
+
+    hierarchy.clear();
+    landmarks.clear();
+    static_dirty = true;
+    nodes_index.build(this->coordinates);
+    zoom = 1;
+    pan = {0, 0};
+    picked_start = picked_end = -1;
     clear_selection();
     return true;
 }
@@ -67,18 +125,57 @@ void SparseGraphView::show_window() {
     ImGui::SetWindowSize({500, 500}, ImGuiCond_Once);
 
     ImDrawList *draw_list = ImGui::GetWindowDrawList();
-    const auto p = ImGui::GetCursorScreenPos();
-    const auto a = (Vec2(ImGui::GetWindowSize()) - Vec2{30, 30}) / bounds;
+    const Vec2 const_p = ImGui::GetCursorScreenPos();
+    Vec2 available_space = ImGui::GetContentRegionAvail();
+    if(abs(available_space.x) <= 1) available_space.x = 1;
+    if(abs(available_space.y) <= 1) available_space.y = 1;
+    ImGui::InvisibleButton("canvas", available_space,
+        ImGuiButtonFlags_MouseButtonLeft | ImGuiButtonFlags_MouseButtonRight);
+    const bool hovered = ImGui::IsItemHovered();
+    const Vec2 mouse = ImGui::GetMousePos();
 
-    // Edges
-    for(const auto &edge : graph.get_edges()) {
-        if (!edge.second.connected) continue;
-        draw_list->AddLine(
-            coordinates[edge.first.first] * a + p,
-            coordinates[edge.first.second] * a + p,
-            ImColor(.3f, .3f, .3f, .3f),
-            0.7f
-        );
+    // Panning with the middle button, zooming around the mouse
+    const Vec2 fit = (Vec2(ImGui::GetWindowSize()) - Vec2{30, 30}) / bounds;
+    if(hovered && ImGui::IsMouseDragging(ImGuiMouseButton_Middle, 0))
+        pan += ImGui::GetIO().MouseDelta;
+    const float wheel = ImGui::GetIO().MouseWheel;
+    if(hovered && wheel != 0) {
+        const Vec2 mouse_point = (mouse - const_p - pan) / (fit * zoom);
+        zoom = min(max(zoom * pow(1.1f, wheel), MIN_ZOOM), MAX_ZOOM);
+        pan = mouse - const_p - mouse_point * fit * zoom;
+    }
+    const Vec2 p = const_p + pan;
+    const Vec2 a = fit * zoom;
+
+    // Picking the nodes, the index is searched in the screen distances
+    const int hovered_node = hovered && graph.n > 0 ?
+        nodes_index.nearest((mouse - p) / a, a, PICK_RADIUS) : -1;
+    if(hovered_node != -1) {
+        if(ImGui::IsItemClicked(ImGuiMouseButton_Left)) {
+            picked_start = hovered_node;
+            picked_changed = true;
+        }
+        if(ImGui::IsItemClicked(ImGuiMouseButton_Right)) {
+            picked_end = hovered_node;
+            picked_changed = true;
+        }
+        ImGui::SetTooltip("%d", hovered_node);
+    }
+
+    const bool gpu = renderer.is_available();
+
+    // The static edges and nodes
+    if(gpu) {
+        if(static_dirty) update_instances();
+        renderer.set_transform(p, a);
+        renderer.draw(draw_list);
+    }
+    else {
+        const Vec2 white_pixel = ImGui::GetDrawListSharedData()->TexUvWhitePixel;
+        if(static_dirty || a.x != cached_scale.x || a.y != cached_scale.y ||
+            white_pixel.x != cached_white_pixel.x || white_pixel.y != cached_white_pixel.y)
+            update_cached_geometry(draw_list, a);
+        draw_cached_geometry(draw_list, p);
     }
 
     // Path
@@ -94,33 +191,136 @@ void SparseGraphView::show_window() {
         }
     }
 
-    // Nodes
-    for(int i = 0; i < graph.n; i++) {
-        if(!selected_nodes[i]) {
-            draw_list->AddCircleFilled(
-                coordinates[i] * a + p,
-                1.0, ImColor(1.0f, 1.0f, 1.0f, 1.0f)
-            );
-        }
-        else {
-            draw_list->AddCircleFilled(
-                coordinates[i] * a + p,
-                3, ImColor(.0f, .8f, .0f, 1.0f)
-            );
-        }
+    // Selected nodes, on top of the static ones
+    if(selection_dirty) {
+        selected_nodes.erase(remove_if(selected_nodes.begin(), selected_nodes.end(), [&](int node) {
+            if(nodes_selection[node] == SELECTED) return false;
+            nodes_selection[node] = NOT_SELECTED;
+            return true;
+        }), selected_nodes.end());
+        selection_dirty = false;
+    }
+    for(const int i : selected_nodes) {
+        draw_list->AddCircleFilled(
+            coordinates[i] * a + p,
+            3, selected_color
+        );
     }
 
+    // Picked and hovered nodes
+    if(picked_start != -1)
+        draw_list->AddCircle(coordinates[picked_start] * a + p, 6, start_color, 0, 2);
+    if(picked_end != -1)
+        draw_list->AddCircle(coordinates[picked_end] * a + p, 6, end_color, 0, 2);
+    if(hovered_node != -1)
+        draw_list->AddCircle(coordinates[hovered_node] * a + p, 5, node_color);
+
     ImGui::End();
 }
 
+void SparseGraphView::update_instances() {
+    vector<InstancedRenderer::EdgeInstance> edges;
+    for(const auto &edge : graph.get_edges()) {
+        if (!edge.connected) continue;
+        edges.push_back({coordinates[edge.first], coordinates[edge.second], edge_color, 0.7f});
+    }
+    vector<InstancedRenderer::NodeInstance> nodes(graph.n);
+    for(int i = 0; i < graph.n; i++)
+        nodes[i] = {coordinates[i], 1.0f, node_color};
+
+    renderer.set_edges(edges);
+    renderer.set_nodes(nodes);
+    static_dirty = false;
+}
+
+void SparseGraphView::update_cached_geometry(const ImDrawList* target, Vec2 scale) {
+    ImDrawList scratch(ImGui::GetDrawListSharedData());
+    scratch._ResetForNewFrame();
+    scratch.Flags = target->Flags;
+    scratch.PushClipRectFullScreen();
+
+    for(const auto &edge : graph.get_edges()) {
+        if (!edge.connected) continue;
+        scratch.AddLine(
+            coordinates[edge.first] * scale,
+            coordinates[edge.second] * scale,
+            edge_color,
+            0.7f
+        );
+    }
+    for(int i = 0; i < graph.n; i++)
+        scratch.AddCircleFilled(coordinates[i] * scale, 1.0, node_color);
+
+    // The list switches to a new vertex offset (a new command) before the
+    // 16 bit indices overflow, so every command is a separate chunk
+    cached_geometry.clear();
+    for(int c = 0; c < scratch.CmdBuffer.Size; c++) {
+        const ImDrawCmd& cmd = scratch.CmdBuffer[c];
+        if(cmd.ElemCount == 0) continue;
+        const ImDrawIdx* indices = scratch.IdxBuffer.Data + cmd.IdxOffset;
+        int vertices_count = 0;
+        for(int i = 0; i < cmd.ElemCount; i++)
+            vertices_count = max(vertices_count, indices[i] + 1);
+
+        CachedChunk chunk;
+        chunk.vertices.assign(
+            scratch.VtxBuffer.Data + cmd.VtxOffset,
+            scratch.VtxBuffer.Data + cmd.VtxOffset + vertices_count);
+        chunk.indices.assign(indices, indices + cmd.ElemCount);
+        cached_geometry.push_back(move(chunk));
+    }
+
+    cached_scale = scale;
+    cached_white_pixel = ImGui::GetDrawListSharedData()->TexUvWhitePixel;
+    static_dirty = false;
+}
+
+void SparseGraphView::draw_cached_geometry(ImDrawList* draw_list, Vec2 offset) const {
+    for(const auto& chunk : cached_geometry) {
+        draw_list->PrimReserve(chunk.indices.size(), chunk.vertices.size());
+        // Taken after the reserve, which may start a new vertex offset
+        const ImDrawIdx base = draw_list->_VtxCurrentIdx;
+        for(const auto& vertex : chunk.vertices) {
+            *draw_list->_VtxWritePtr = vertex;
+            draw_list->_VtxWritePtr->pos.x += offset.x;
+            draw_list->_VtxWritePtr->pos.y += offset.y;
+            draw_list->_VtxWritePtr++;
+        }
+        for(const auto index : chunk.indices)
+            *draw_list->_IdxWritePtr++ = base + index;
+        draw_list->_VtxCurrentIdx += chunk.vertices.size();
+    }
+}
+
 void SparseGraphView::set_current_path(vector<int> new_path)
 { current_path = new_path; }
 
-void SparseGraphView::set_node_selection(int node_id, bool selection)
-{ selected_nodes[node_id] = selection; }
+void SparseGraphView::set_node_selection(int node_id, bool selection) {
+    if(node_id < 0 || node_id >= nodes_selection.size()) return;
+    char& state = nodes_selection[node_id];
+    if(selection) {
+        if(state == NOT_SELECTED) selected_nodes.push_back(node_id);
+        state = SELECTED;
+    }
+    else if(state == SELECTED) {
+        state = DESELECTED;
+        selection_dirty = true;
+    }
+}
 void SparseGraphView::clear_selection() {
     current_path.clear();
-    fill(selected_nodes.begin(), selected_nodes.end(), false);
+    for(const int node : selected_nodes) nodes_selection[node] = NOT_SELECTED;
+    nodes_selection.resize(graph.n, NOT_SELECTED);
+    selected_nodes.clear();
+    selection_dirty = false;
+}
+
+bool SparseGraphView::take_picked_nodes(int& start, int& end) {
+    if(!picked_changed) return false;
+    start = picked_start;
+    end = picked_end;
+    picked_changed = false;
+    return true;
 }
 
 float SparseGraphView::get_distance(int node_a, int node_b) const
@@ -0,0 +1,108 @@
+#include "step_trace.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+    using Selection = StepTrace::Selection;
+
+    bool is_same_selection(const Selection& a, const Selection& b) {
+        const ImVec4 &x = a.color.Value, &y = b.color.Value;
+        return a.is_selected == b.is_selected &&
+            x.x == y.x && x.y == y.y && x.z == y.z && x.w == y.w;
+    }
+
+    void set_selection(vector<Selection>& selections, int id, const Selection& value) {
+        // The graph could have been changed since the recording
+        if(id >= 0 && id < selections.size()) selections[id] = value;
+    }
+}
+
+StepTrace::StepTrace(): events(), step_ends(), keyframes(), position(0) {}
+
+void StepTrace::clear() {
+    events.clear();
+    step_ends.clear();
+    keyframes.clear();
+    position = 0;
+}
+
+StepTrace::Keyframe StepTrace::take_keyframe(Field& field, int event) {
+    Keyframe ret;
+    ret.event = event;
+    for(const auto& graph : field.get_graphs()) {
+        ret.points_sel.push_back(graph.points_sel);
+        ret.edges_sel.push_back(graph.edges_sel);
+    }
+    return ret;
+}
+
+void StepTrace::start(Field& field) {
+    clear();
+    keyframes.push_back(take_keyframe(field, 0));
+    field.set_trace(this);
+}
+
+void StepTrace::finish(Field& field) {
+    field.set_trace(nullptr);
+    position = events.size();
+
+    // The keyframes are taken by replaying the events once from the start
+    Keyframe frame = keyframes[0];
+    int event = 0;
+    for(int step = KEYFRAME_STEPS; step < step_ends.size(); step += KEYFRAME_STEPS) {
+        for(; event < step_ends[step]; event++) {
+            const Event& e = events[event];
+            if(e.graph_id >= frame.points_sel.size()) continue;
+            set_selection(e.target == Point ? frame.points_sel[e.graph_id] : frame.edges_sel[e.graph_id],
+                e.id, e.after);
+        }
+        frame.event = event;
+        keyframes.push_back(frame);
+    }
+}
+
+void StepTrace::record(Target target, int graph_id, int id, const Selection& before, const Selection& after) {
+    if(is_same_selection(before, after)) return;
+    events.push_back({target, graph_id, id, before, after});
+}
+
+void StepTrace::end_step() { step_ends.push_back(events.size()); }
+
+int StepTrace::get_steps_count() const { return step_ends.size(); }
+
+void StepTrace::apply(Field& field, const Event& event, bool forward) const {
+    if(event.graph_id >= field.get_graphs().size()) return;
+    auto& graph = *field.get_graph(event.graph_id);
+    set_selection(event.target == Point ? graph.points_sel : graph.edges_sel,
+        event.id, forward ? event.after : event.before);
+}
+
+void StepTrace::seek(Field& field, int step) {
+    if(keyframes.empty()) return;
+    step = min(max(step, 0), get_steps_count());
+    const int target = step < step_ends.size() ? step_ends[step] : events.size();
+
+    // Restoring the last keyframe before the target, when it is cheaper
+    // than going through the events from the shown step
+    const auto frame = prev(upper_bound(keyframes.begin(), keyframes.end(), target,
+        [](int event, const Keyframe& frame) { return event < frame.event; }));
+    int frame_size = 0;
+    for(int g = 0; g < frame->points_sel.size(); g++)
+        frame_size += frame->points_sel[g].size() + frame->edges_sel[g].size();
+    if(frame_size + target - frame->event < abs(target - position)) {
+        const int graphs_count = min(frame->points_sel.size(), field.get_graphs().size());
+        for(int g = 0; g < graphs_count; g++) {
+            auto& graph = *field.get_graph(g);
+            if(graph.points_sel.size() == frame->points_sel[g].size())
+                graph.points_sel = frame->points_sel[g];
+            if(graph.edges_sel.size() == frame->edges_sel[g].size())
+                graph.edges_sel = frame->edges_sel[g];
+        }
+        position = frame->event;
+    }
+
+    while(position < target) apply(field, events[position++], true);
+    while(position > target) apply(field, events[--position], false);
+}
@@ -0,0 +1,78 @@
+#include "thread_pool.h"
+
+#include "utils.h"
+#include "main.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(int threads):
+    workers(), job{nullptr, 0, 1, 0}, generation(0),
+    next_chunk(0), running_workers(0), stopping(false) {
+    #ifndef NO_THREADS
+    if(threads <= 0) threads = thread::hardware_concurrency();
+    // The calling thread is one of them
+    for(int i = 1; i < threads; i++)
+        workers.emplace_back(&ThreadPool::worker_loop, this);
+    #endif
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(job_mutex);
+        stopping = true;
+    }
+    job_started.notify_all();
+    for(auto& worker : workers)
+        worker.join();
+}
+
+int ThreadPool::size() const { return workers.size() + 1; }
+
+void ThreadPool::run_chunks() {
+    for(int c = next_chunk++; c < job.chunks; c = next_chunk++) {
+        const int first = c * job.chunk;
+        (*job.body)(first, min(first + job.chunk, job.count));
+    }
+}
+
+void ThreadPool::worker_loop() {
+    unsigned long long seen = 0;
+    while(true) {
+        {
+            unique_lock<mutex> lock(job_mutex);
+            job_started.wait(lock, [&] { return stopping || generation != seen; });
+            if(stopping) return;
+            seen = generation;
+        }
+        run_chunks();
+        {
+            lock_guard<mutex> lock(job_mutex);
+            running_workers--;
+        }
+        job_finished.notify_one();
+    }
+}
+
+void ThreadPool::parallel_for(int count, int chunk, const function<void(int, int)>& body) {
+    if(count <= 0) return;
+    if(chunk <= 0) chunk = 1;
+    const int chunks = (count + chunk - 1) / chunk;
+    if(workers.empty() || chunks == 1) {
+        for(int first = 0; first < count; first += chunk)
+            body(first, min(first + chunk, count));
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(job_mutex);
+        job = {&body, count, chunk, chunks};
+        next_chunk = 0;
+        running_workers = workers.size();
+        generation++;
+    }
+    job_started.notify_all();
+    run_chunks();
+
+    unique_lock<mutex> lock(job_mutex);
+    job_finished.wait(lock, [&] { return running_workers == 0; });
+}
@@ -2,6 +2,19 @@
 
 #include "SDL_keycode.h"
 
+#include <charconv>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 template<typename T>
 ostream& operator<<(ostream& stream, const vector<T> v){
     stream << "vec{ ";
@@ -14,14 +27,129 @@ ostream& operator<<(ostream& stream, const vector<T> v){
 }
 
 string read_file(const string filename) {
-    ifstream file(filename);
-    string ret, buff;
-    while(getline(file, buff))
-        ret += buff + "\n";
+    ifstream file(filename, ios::binary);
+    if(!file) return "";
+    file.seekg(0, ios::end);
+    const streamsize size = file.tellg();
+    file.seekg(0, ios::beg);
+    string ret(size > 0 ? size : 0, '\0');
+    file.read(ret.data(), ret.size());
     file.close();
     return ret;
 }
 
+bool next_line(string_view data, size_t& pos, string_view& line) {
+    if(pos >= data.size()) return false;
+    size_t end = data.find('\n', pos);
+    if(end == string_view::npos) end = data.size();
+    line = data.substr(pos, end - pos);
+    pos = end + 1;
+    return true;
+}
+
+namespace {
+    inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+    inline bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+}
+
+int parse_int_tuple(string_view line, int values[3]) {
+    const char* p = line.data();
+    const char* const end = p + line.size();
+    while(p != end) {
+        while(p != end && !is_digit(*p)) p++;
+        if(p == end) return 0;
+        const auto first = from_chars(p, end, values[0]);
+        p = first.ptr;
+        if(first.ec != errc()) continue;
+
+        const char* q = p;
+        while(q != end && is_space(*q)) q++;
+        if(q == p || q == end || !is_digit(*q)) continue;
+        const auto second = from_chars(q, end, values[1]);
+        if(second.ec != errc()) {
+            p = second.ptr;
+            continue;
+        }
+
+        q = second.ptr;
+        while(q != end && is_space(*q)) q++;
+        if(q == end || !is_digit(*q)) return 2;
+        if(from_chars(q, end, values[2]).ec != errc()) return 2;
+        return 3;
+    }
+    return 0;
+}
+
+MappedFile::MappedFile(): mapped_data(nullptr), mapped_size(0),
+    handle(nullptr), mapping(nullptr), buffer() {}
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const string& filename) {
+    close();
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE file_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(file_mapping == nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+    mapped_data = static_cast<const char*>(MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0));
+    if(mapped_data == nullptr) {
+        CloseHandle(file_mapping);
+        CloseHandle(file);
+        return false;
+    }
+    handle = file;
+    mapping = file_mapping;
+    mapped_size = size.QuadPart;
+#elif !defined(__EMSCRIPTEN__)
+    const int file = ::open(filename.c_str(), O_RDONLY);
+    if(file == -1) return false;
+    struct stat info;
+    if(fstat(file, &info) != 0 || info.st_size == 0) {
+        ::close(file);
+        return false;
+    }
+    void* view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if(view == MAP_FAILED) return false;
+    mapping = view;
+    mapped_data = static_cast<const char*>(view);
+    mapped_size = info.st_size;
+#else
+    buffer = read_file(filename);
+    if(buffer.empty()) return false;
+    mapped_data = buffer.data();
+    mapped_size = buffer.size();
+#endif
+    return true;
+}
+
+void MappedFile::close() {
+#if defined(_WIN32)
+    if(mapped_data != nullptr) UnmapViewOfFile(mapped_data);
+    if(mapping != nullptr) CloseHandle(mapping);
+    if(handle != nullptr) CloseHandle(handle);
+#elif !defined(__EMSCRIPTEN__)
+    if(mapping != nullptr) munmap(mapping, mapped_size);
+#endif
+    buffer.clear();
+    mapped_data = nullptr;
+    mapped_size = 0;
+    handle = nullptr;
+    mapping = nullptr;
+}
+
+const char* MappedFile::data() const { return mapped_data; }
+size_t MappedFile::size() const { return mapped_size; }
+
 // TODO: comment the source
 ImGuiKey ImGui_ImplSDL2_KeycodeToImGuiKey(int keycode)
 {